@@ -71,6 +71,7 @@ const int NO_DBLOOP             = 0x415;
 const int DBLOOP_EXPECTED       = 0x416;
 const int BAD_BITFIELD          = 0x417;
 const int ILLEGAL_SYMBOL        = 0x418;
+const int NO_ENDR               = 0x419;
 
 const int EXCEPTION             = 0x999;
 
@@ -115,6 +116,7 @@ const int THEN_EXPECTED         = 0x108;
 const int DO_EXPECTED           = 0x109;
 const int FORWARD_REF           = 0x10A;
 const int LABEL_TOO_LONG        = 0x10B;
+const int OVERLAP               = 0x10C;
 
 
 const int SEVERITY	            = 0xF00;
@@ -147,23 +149,59 @@ struct opDescriptor
                 // BYTE_SIZE, WORD_SIZE, LONG_SIZE
                 // Also used to prevent MOVEQ, ADDQ & SUBQ optimizations (see OPPARSE.CPP)
   bool backRef;	// True if data field is known on first pass
+  int  fix;     // expression of data kept for a fixup, -1 if none
 };
 
+/* Token of a source line, see tokenize(). The token is a view into the
+   line; it is neither copied nor null terminated. A missing token has
+   start pointing to empty[]. */
+typedef struct {
+	char *start;			/* First character of the token */
+	int length;			/* Number of characters in the token */
+	} tokenSpan;
+
+/* Delimiter sets of tokenize(). Spaces, tabs and newlines delimit tokens
+   in each, with commas or periods as well. */
+const int COMMA_DELIMS          = 0;    /* ", \t\n" operands of a line */
+const int SPACE_DELIMS          = 1;    /* " \t\n" lines of a macro */
+const int DOT_DELIMS            = 2;    /* ". \t\n" structured statements */
+const int DELIM_SETS            = 3;
 
 /* Structure for a symbol table entry */
 typedef struct symbolEntry {
 	int value;			/* 32-bit value of the symbol */
-	struct symbolEntry *next;	/* Pointer to next symbol in linked list */
 	char flags;			/* Flags (see below) */
-	char name[SIGCHARS+1];		/* Name */
+	unsigned char length;		/* Length of name */
+	unsigned int hash;		/* Hash value of name */
+	const char *name;		/* Name, stored in the symbol name pool */
+	struct symbolTable *locals;	/* Local labels of a global label */
 	} symbolDef;
 
+/* FNV-1a hash constants, shared by the symbol table and the instruction
+   table so an opcode is hashed only once for both */
+const unsigned int FNV_BASIS = 2166136261u;
+const unsigned int FNV_PRIME = 16777619u;
+
 /* Flag values for the "flags" field of a symbol */
 const int BACKREF	    = 0x01;	/* Set when the symbol is defined on the 2nd pass */
 const int REDEFINABLE	= 0x02;	/* Set for symbols defined by the SET directive */
 const int REG_LIST_SYM	= 0x04;	/* Set for symbols defined by the REG directive */
 const int MACRO_SYM     = 0x08;    // Set for macros
 const int DS_SYM        = 0x10;    // Set for labels defined with DS directive
+const int OLD_SYM       = 0x20;    // Set for symbols of the previous pass 1 (OPT RELAX)
+
+/* Kinds of operand that OPT RELAX may shorten, see relaxed() */
+const int RELAX_BRANCH  = 0;       // forward Bcc, BRA or BSR without size
+const int RELAX_ABS     = 1;       // forward absolute address without size
+
+/* Kinds of field that a fixup fills in at the end of one pass assembly,
+   see outputFix() */
+const int FIX_BYTE      = 0;       // 8 bit data
+const int FIX_WORD      = 1;       // 16 bit data
+const int FIX_LONG      = 2;       // 32 bit data or absolute address
+const int FIX_DISP8     = 3;       // displacement of an index mode
+const int FIX_DISP16    = 4;       // 16 bit displacement or short address
+const int FIX_SHORT     = 5;       // displacement of a short branch
 
 /* Instruction table definitions */
 
@@ -184,7 +222,7 @@ typedef struct {
 /* Structure for the instruction table */
 typedef struct {
 	const char *mnemonic;		/* Mnemonic */
-	flavor *flavorPtr;	/* Pointer to flavor list */
+	const flavor *flavorPtr;	/* Pointer to flavor list */
 	char flavorCount;	/* Number of flavors in flavor list */
 	bool parseFlag;		/* Should assemble() parse the operands? */
 	int (*exec)(int, char *, char *, int *);
@@ -192,6 +230,60 @@ typedef struct {
 	} instruction;
 
 
+/* What the text of a source line tells about it. It is worked out the
+   first time the line is assembled and reused on later passes and
+   INCLUDEs of the line, see assemble() and createCode(). Nothing that
+   depends on the value of a symbol is kept. */
+typedef struct {
+	const instruction *inst;	/* Instruction or directive */
+	int operand;			/* Offset of the operands in the line */
+	int srcEnd, destEnd;		/* Offset after register operands */
+	int error;			/* Errors in the label and opcode */
+	unsigned char state;		/* LINE_NEW, LINE_LABEL or LINE_CODE */
+	unsigned char cond;		/* COND_ value of the opcode */
+	unsigned char labelLength;	/* Length of the label, 0 if none */
+	char size;			/* Size code of the instruction */
+	unsigned char srcMode, srcReg;	/* Register operands, mode index + 1 */
+	unsigned char destMode, destReg;	/*  or 0 if not kept */
+	struct exprCode *expr;		/* Compiled expressions, see EVAL.CPP */
+	int skip;			/* Lines from IFxx to its ENDC or from
+					   MACRO to its ENDM, 0 if not known,
+					   -1 if they can't be skipped */
+	} lineIR;
+
+const int LINE_NEW   = 0;		/* Nothing known about the line yet */
+const int LINE_LABEL = 1;		/* Label only */
+const int LINE_CODE  = 2;		/* Label and opcode known */
+
+const int COND_UNKNOWN = 0;		/* Line not tokenized yet */
+const int COND_NO      = 1;		/* Opcode is no conditional directive */
+const int COND_IF      = 2;		/* IFC, IFNC, IFEQ ... IFGE */
+const int COND_ENDC    = 3;		/* ENDC */
+const int COND_LABEL   = 4;		/* Added if the directive has a label */
+
+/* Source file read into memory, see SOURCE.CPP */
+typedef struct {
+	char *text;			/* Lines of the file, each followed by '\0' */
+	char *folded;			/* text converted by strcap() */
+	int *lineStart;			/* Offset of each line in text, and
+					   of the end of the last line */
+	lineIR *ir;			/* What is known about each line */
+	int lineCount;			/* Number of lines */
+	} sourceFile;
+
+/* What ENDF needs of its FOR, see STRUCTURED.CPP */
+typedef struct {
+	std::string size;		/* Size of ADD/SUB and CMP, as listed */
+	std::string counter;		/* op1 */
+	std::string limit;		/* op3 */
+	std::string step;		/* op4 or #1 */
+	const char *addSub;		/* "ADD" for TO, "SUB" for DOWNTO */
+	const char *bcc;		/* "BLE" for TO, "BGE" for DOWNTO */
+	std::string extent;		/* Extent of the branch, as listed */
+	unsigned int label;		/* Label of the loop body */
+	} forLoop;
+
+
 /* Addressing mode codes/bitmasks */
 
 const int DnDirect		= 0x00001;
@@ -226,9 +318,43 @@ const int WORD_SIZE  = 2;
 const int LONG_SIZE  = 4;
 const int SHORT_SIZE = 8;
 
+
+/* Addressing mode dispatch table of an instruction. The tables are built
+   at compile time from the flavor lists (see instructionstable.cpp) and
+   give the flavor that createCode() would find by walking the list. */
+
+const int NMODES = 18;		/* number of addressing mode codes */
+const int MAXFLAVORS = 8;	/* maximum length of a flavor list */
+const int NOFLAVOR = 0xFF;	/* no flavor matches */
+
+/* Return index of single bit addressing mode, NMODES if not a valid mode */
+constexpr int modeIndex(int mode)
+{
+  return (mode > 0 && mode <= VBRDirect && !(mode & (mode - 1)))
+         ? __builtin_ctz(mode) : NMODES;
+}
+
+typedef struct {
+	bool zeroOp;		/* First flavor has no operands */
+	bool srcField;		/* Source may be followed by {offset:width} */
+	bool destField;		/* Destination is followed by {offset:width} */
+	unsigned char destFlavor;	/* First flavor with a destination */
+	unsigned char noDest[NMODES+1];	/* Flavor by source mode found before
+					   the destination is parsed */
+	unsigned char withDest[NMODES+1][NMODES+1];
+				/* Flavor by source and destination mode */
+	unsigned short mask[MAXFLAVORS][SHORT_SIZE+1];
+				/* Skeleton mask by flavor and size code */
+	unsigned short badSize[MAXFLAVORS];
+				/* Bit set for each invalid size code */
+	} instDispatch;
+
 // upper limit of 68000 memory
 const int MEM_SIZE = 0x00FFFFFF;
 
+// largest byte count of an S-record, which is one byte
+const int SREC_MAX = 255;
+
 // function return codes
 const int NORMAL = 0;
 const int MILD_ERROR = 1;
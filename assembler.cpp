@@ -22,9 +22,9 @@
  *		this search is successful and the parseFlag for that
  *		instruction is TRUE, it defines the label and parses
  *		the source and destination operands of the instruction
- *		(if appropriate) and searches the flavor list for the
- *		instruction, calling the proper routine if a match is
- *		found. If parseFlag is FALSE, it passes pointers to the
+ *		(if appropriate) and finds the matching flavor in the
+ *		dispatch table of the instruction, calling the proper
+ *		routine if a match is found. If parseFlag is FALSE, it passes pointers to the
  *		label and operands to the specified routine for
  *		processing.
  *
@@ -78,6 +78,9 @@
  ************************************************************************/
 #include <stdio.h>
 #include <ctype.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "asm.h"
 #include "proto.h"
 #include <string>
@@ -88,7 +91,7 @@
 extern int loc;		// The assembler's location counter
 extern int sectionLoc[16];     // section locations
 extern int  sectI;              // current section
-extern int offsetMode;         // True when processing Offset directive
+extern bool offsetMode;        // True when processing Offset directive
 extern bool showEqual;          // true to display equal after address in listing
 extern char pass;		// pass counter
 extern bool pass2;		// Flag set during second pass
@@ -100,16 +103,22 @@ extern int lineNum;
 extern int lineNumL68;
 extern int errorCount, warningCount;
 
-extern char line[256];		// Source line
-extern FILE *inFile;		// Input file
+extern char *line;		// Source line
+extern char *lineBuffer;	// buffer for lines not in a source file
+extern int lineSize;		// size of lineBuffer
+extern sourceFile *inSource;	// Input file
+extern int inLine;		// index of next line of inSource
+extern lineIR *curIR;		// lineIR of the source line
 extern FILE *listFile;		// Listing file
 extern FILE *objFile;	        // Object file
 extern FILE *errFile;		// error message file
-extern FILE *tmpFile;           // temp file
 
 extern int labelNum;            // macro label \@ number
 extern bool listFlag;           // True if a listing is desired
 extern bool objFlag;	        // True if an object code file is desired
+extern bool s68Flag, binFlag, hexFlag;  // object code files desired
+extern char *deltaName;         // previous S-Record file for -d, or NULL
+extern bool objOverlap;         // set when code is output over earlier code
 extern bool xrefFlag;	        // True if a cross-reference is desired
 extern bool CEXflag;	        // True is Constants are to be EXpanded
 extern bool BITflag;            // True to assemble bitfield instructions
@@ -121,7 +130,7 @@ extern bool noENDM;             // set true if no ENDM in macro
 extern int macroNestLevel;      // count nested macro calls
 extern char buffer[256];  //ck used to form messages for display in windows
 extern char numBuf[20];
-extern char globalLabel[SIGCHARS+1];
+extern symbolDef *globalScope;   // last global label, scope of local labels
 extern int includeNestLevel;    // count nested include directives
 extern char includeFile[256];  // name of current include file
 extern bool includedFileError; // true if include error message displayed
@@ -138,10 +147,8 @@ bool printCond;                 // true to print condition on listing line
 bool skipCreateCode;            // true to skip calling createCode during macro processing
 
 const int MAXT = 128;           // maximum number of tokens
-const int MAX_SIZE = 512;       // maximun size of input line
-char *token[MAXT];              // pointers to tokens
-char tokens[MAX_SIZE];          // place tokens here
-char *tokenEnd[MAXT];           // where tokens end in source line
+tokenSpan token[MAXT];          // tokens of the current line
+int tokenUsed = MAXT;           // slots of token[] used by last line
 int nestLevel = 0;              // nesting level of conditional directives
 
 extern bool mapROM;             // memory map flags
@@ -153,11 +160,40 @@ extern std::stack<int,std::vector<int> > stcStack;
 // Make a stack for saving dbloop register number
 extern std::stack<char, std::vector<char> > dbStack;
 // Make a stack for saving FOR arguments
-extern std::stack<std::string, std::vector<std::string> > forStack;
+extern std::stack<forLoop, std::vector<forLoop> > forStack;
+
+extern bool RELAXflag;          // true repeats pass 1 to shorten forward references
+extern int symbolsRenewed;      // OLD_SYM symbols defined again
+extern bool symbolsChanged;     // a symbol is new or changed value
+extern bool onePass;            // true while assembling in one pass
+
+// OPT RELAX
+// The first pass 1 makes every forward reference long, as without RELAX.
+// Pass 1 is then repeated with the symbols of the previous pass 1 as
+// estimates. A site, a forward reference that may be short, becomes short
+// when its estimate fits and stays long for good if it no longer fits
+// after that, so the sizes settle. When a pass 1 changes no site and no
+// symbol, pass 2 assembles the same layout and no PHASE_ERROR can occur.
+// If the sizes do not settle in RELAX_LIMIT repeats, pass 1 is run once
+// more with every site long.
+const int RELAX_LIMIT = 16;     // maximum number of pass 1 repeats
+const unsigned char SITE_LONG = 0;      // site states
+const unsigned char SITE_SHORT = 1;
+const unsigned char SITE_PINNED = 2;    // long after being short
+struct relaxSite {
+  int loc;                      // location in last pass 1
+  unsigned char state;
+};
+std::vector<relaxSite> relaxSites;      // sites in order
+int relaxNext;                  // number of next site in pass
+int relaxCount = 0;             // pass 1 repeats
+bool relaxChanged;              // true if a site changed state in pass 1
+bool relaxFailed = false;       // true if the sizes did not settle
+int relaxSymbols;               // symbols of previous pass 1
 
 //------------------------------------------------------------
 // Assemble source file
-int assembleFile(char fileName[], char tempName[], std::string outName ,std::string workName)
+int assembleFile(char fileName[], std::string outName ,std::string workName)
 {
   int i;
 
@@ -166,14 +202,8 @@ int assembleFile(char fileName[], char tempName[], std::string outName ,std::str
   sOutname.append(".L68");
 
   try {
-    tmpFile = fopen(tempName, "w+");
-    if (!tmpFile) {
-      sprintf(buffer,"Error creating temp file.");
-      return SEVERE;
-    }
-
-    inFile = fopen(fileName, "r");
-    if (!inFile) {
+    inSource = loadSource(fileName);
+    if (!inSource) {
       printf("Error reading source file.");
       return SEVERE;
     }
@@ -186,23 +216,57 @@ int assembleFile(char fileName[], char tempName[], std::string outName ,std::str
     initList(sOutname.data());                // initialize list file
     
 
+    // -d reads the previous image before its file may be replaced
+    if (deltaName && loadDelta(deltaName) != NORMAL) {
+      printf("%s", buffer);
+      deltaName = NULL;
+    }
+
     // if Object file flag then create .S68 file (S-Record)
     //if (objFlag) {
       sOutname = outName.data();
 
       sOutname.append(".S68");
-     if(initObj(sOutname.data()) != NORMAL) { 
+     if(s68Flag && initObj(sOutname.data()) != NORMAL) { 
          // if error initializing object file
-          objFlag = false;                     
+          s68Flag = false;                     
        }   // disable object file creation
   //  }
 
+    // .BIN file (binary) and .HEX file (Intel HEX) from the same image
+    if (binFlag) {
+      sOutname = outName.data();
+      sOutname.append(".BIN");
+      if (initBin(sOutname.data()) != NORMAL)
+        binFlag = false;
+    }
+    if (hexFlag) {
+      sOutname = outName.data();
+      sOutname.append(".HEX");
+      if (initIntel(sOutname.data()) != NORMAL)
+        hexFlag = false;
+    }
+    objFlag = s68Flag || binFlag || hexFlag;
+
+    // .D68 file (changed S-Records) and .PAT file (changed binary ranges)
+    if (deltaName) {
+      std::string recordName = outName + ".D68";
+      std::string patchName = outName + ".PAT";
+      if (initDelta(s68Flag ? &recordName[0] : NULL,
+                    binFlag ? &patchName[0] : NULL) != NORMAL) {
+        printf("%s\n", buffer);
+        deltaName = NULL;
+      }
+      objFlag = true;
+    }
+
     // Assemble the file
     processFile();
 
     // Close files and print error and warning counts
-    fclose(inFile);
-    fclose(tmpFile);
+    clearMacros();
+    clearExprCache();
+    clearSources();
     finishList();
     if (objFlag)
       finishObj();
@@ -231,12 +295,47 @@ int assembleFile(char fileName[], char tempName[], std::string outName ,std::str
 }
 
 
+// Copy s to d converting to upper case everything outside single quotes.
+// When SSE2 is available blocks of 16 characters that contain no quote
+// are converted at once. Only whole blocks before the end of the string
+// are loaded, the rest is done one character at a time.
 int strcap(char *d, char *s)
 {
   bool capFlag;
 
   try {
 	capFlag = true;
+#ifdef __SSE2__
+	const char *end = s + strlen(s);
+	const __m128i quote = _mm_set1_epi8('\'');
+	const __m128i lowA = _mm_set1_epi8('a' - 1);
+	const __m128i lowZ = _mm_set1_epi8('z' + 1);
+	const __m128i caseBit = _mm_set1_epi8(0x20);
+	__m128i block, lower;
+
+	while (end - s >= 16) {
+		block = _mm_loadu_si128((const __m128i *) s);
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(block, quote)) == 0) {
+			if (capFlag) {		// clear case bit of a-z
+				lower = _mm_and_si128(_mm_cmpgt_epi8(block, lowA),
+					_mm_cmplt_epi8(block, lowZ));
+				block = _mm_sub_epi8(block, _mm_and_si128(lower, caseBit));
+				}
+			_mm_storeu_si128((__m128i *) d, block);
+			d += 16;
+			s += 16;
+			}
+		else {			// quote in block
+			for (int i=0; i<16; i++) {
+				*d = (capFlag) ? toupper(*s) : *s;
+				if (*s == '\'')
+					capFlag = !capFlag;
+				d++;
+				s++;
+				}
+			}
+		}
+#endif
 	while (*s) {
 		if (capFlag)
 			*d = toupper(*s);
@@ -273,62 +372,204 @@ char *skipSpace(char *p)
   }
 }
 
+// Make room for size characters in lineBuffer. The contents are kept and
+// line follows lineBuffer if it points to it. A replaced buffer is not
+// released because pointers to it may still be held by callers further
+// up (assemble() of a macro call).
+char *lineReserve(int size)
+{
+  char *newBuffer;
+
+  if (size > lineSize) {
+    while (lineSize < size)
+      lineSize *= 2;
+    newBuffer = (char *) malloc(lineSize);
+    memcpy(newBuffer, lineBuffer, strlen(lineBuffer) + 1);
+    if (line == lineBuffer)
+      line = newBuffer;
+    lineBuffer = newBuffer;
+  }
+  return lineBuffer;
+}
+
+//--------------------------------------------------------
+// Return true if the forward reference at the next OPT RELAX site is
+// short. kind is RELAX_BRANCH for the target of a branch or RELAX_ABS
+// for an absolute address; value is the estimate of the target or
+// address from the previous pass 1, which decides the size in a repeated
+// pass 1. Pass 2 uses the size of the last pass 1.
+bool relaxed(int kind, int value)
+{
+  int disp;
+  bool fits;
+
+  if (!relaxCount || relaxFailed)       // first pass 1 or not relaxing
+    return false;
+  if (relaxNext == (int) relaxSites.size()) {
+    if (pass2)                          // not a site in pass 1
+      return false;
+    relaxSite site = { loc, SITE_LONG };
+    relaxSites.push_back(site);
+    if (relaxCount > 1)                 // not a site in previous pass 1
+      relaxChanged = true;
+  }
+  relaxSite &site = relaxSites[relaxNext++];
+  if (!pass2) {
+    if (site.state != SITE_PINNED) {
+      if (kind == RELAX_BRANCH) {
+        // the displacement in the layout of the previous pass 1
+        disp = value - site.loc - 2;
+        if (site.state == SITE_LONG)    // target moves when branch is short
+          disp -= 2;
+        fits = (disp >= 1 && disp <= 127);
+      } else
+        fits = (value >= -32768 && value <= 32767);
+      if (site.state == SITE_LONG && fits) {
+        site.state = SITE_SHORT;
+        relaxChanged = true;
+      } else if (site.state == SITE_SHORT && !fits) {
+        site.state = SITE_PINNED;
+        relaxChanged = true;
+      }
+    }
+    site.loc = loc;
+  }
+  return site.state == SITE_SHORT;
+}
+
+//--------------------------------------------------------
+// Empty the stacks of structured statements
+static void clearStacks()
+{
+  while (!stcStack.empty())
+    stcStack.pop();
+  while (!dbStack.empty())
+    dbStack.pop();
+  while (!forStack.empty())
+    forStack.pop();
+}
+
+//--------------------------------------------------------
+// Called at the end of pass 1. Returns true if OPT RELAX repeats pass 1.
+static bool relaxRepeat()
+{
+  if (!RELAXflag || relaxFailed)
+    return false;
+  if (relaxCount) {
+    if (relaxNext != (int) relaxSites.size()) {  // sites were dropped
+      relaxSites.resize(relaxNext);
+      relaxChanged = true;
+    }
+    if (!relaxChanged && !symbolsChanged && symbolsRenewed == relaxSymbols)
+      return false;                     // layout did not change
+    if (relaxCount == RELAX_LIMIT)      // sizes did not settle
+      relaxFailed = true;
+  }
+  relaxSymbols = ageSymbols();
+  relaxCount++;
+  clearStacks();                        // start pass 1 as the first one
+  return true;
+}
+
+// Clear the flags that hold from one pass to the next
+static void startFile()
+{
+  offsetMode = false;           // clear flags
+  showEqual = false;
+  pass2 = false;
+  macroNestLevel = 0;           // count nested macro calls
+  noENDM = false;               // set to true if no ENDM in macro
+  includedFileError = false;    // true if include error message displayed
+  mapROM = false;               // memory map flags
+  mapRead = false;
+  mapProtected = false;
+  mapInvalid = false;
+  nestLevel = 0;                // nesting level of conditional directives
+}
+
+// Assemble each line of the source file once. One pass assembly stops
+// at the first line that needs two passes.
+static void runPass()
+{
+  int error;
+
+  globalScope = NULL;           // for local labels
+  labelNum = 0;                 // macro label \@ number
+  // evalNumber() contains error code that depends on the range of these numbers
+  stcLabelI = 0x00000000;       // structured if label number
+  stcLabelW = 0x10000000;       // structured while label number
+  stcLabelF = 0x20000000;       // structured for label number
+  stcLabelR = 0x30000000;       // structured repeat label number
+  stcLabelD = 0x40000000;       // structured dbloop label number
+  includeNestLevel = 0;         // count nested include directives
+  includeFile[0] = '\0';        // name of current include file
+
+  loc = 0;
+  for (int i=0; i<16; i++)      // clear section locations
+    sectionLoc[i] = 0;
+  sectI = 0;                    // current section
+
+  relaxNext = 0;                // first OPT RELAX site
+  relaxChanged = false;
+
+  lineNum = 1;
+  lineNumL68 = 1;
+  endFlag = false;
+  errorCount = warningCount = 0;
+  skipCond = false;             // true conditionally skips lines in code
+  inLine = 0;
+  while(!endFlag && nextLine()) {
+    error = OK;
+    continuation = false;
+    skipList = false;
+    printCond = false;          // true to print condition on listing line
+    skipCreateCode = false;
+
+    assemble(line, &error);     // assemble one line of code
+    lineNum++;
+    if (onePass && !fixLine())  // the line needs two passes
+      break;
+  }
+}
+
 // continue assembly process by reading source file and sending each
 // line to assemble()
-// does 2 passes from here
+// does 1 or 2 passes from here
 int processFile()
 {
   int error;
-  bool comment;                 // true when line is comment
-  int value;
-  bool backRef;
-
 
   try {
-    offsetMode = false;         // clear flags
-    showEqual = false;
-    pass2 = false;
-    macroNestLevel = 0;         // count nested macro calls
-    noENDM = false;             // set to true if no ENDM in macro
-    includedFileError = false;  // true if include error message displayed
-    mapROM = false;             // memory map flags
-    mapRead = false;
-    mapProtected = false;
-    mapInvalid = false;
+    // A source file whose layout does not depend on a forward reference
+    // is assembled in one pass with fixups, see FIXUP.CPP. Otherwise
+    // two passes are run as if the one pass had not been.
+    startFile();
+    if (fixStart()) {
+      pass = 0;                 // macro bodies are stored as in pass 1
+      pass2 = true;
+      runPass();
+      if (fixFinish(nestLevel == 0 && stcStack.empty() && dbStack.empty() &&
+                    forStack.empty())) {
+        if(!endFlag) {          // if no END directive was found
+          error = END_MISSING;
+          warningCount++;
+          printError(listFile, error, lineNum);
+        }
+        return NORMAL;
+      }
+      ageSymbols();             // symbols are undefined until pass 1
+      clearMacros();            // macro bodies are numbered again
+      clearStacks();
+    }
 
+    startFile();
     for (pass = 0; pass < 2; pass++) {
-      globalLabel[0] = '\0';    // for local labels
-      labelNum = 0;             // macro label \@ number
-      // evalNumber() contains error code that depends on the range of these numbers
-      stcLabelI = 0x00000000;   // structured if label number
-      stcLabelW = 0x10000000;   // structured while label number
-      stcLabelF = 0x20000000;   // structured for label number
-      stcLabelR = 0x30000000;   // structured repeat label number
-      stcLabelD = 0x40000000;   // structured dbloop label number
-      includeNestLevel = 0;     // count nested include directives
-      includeFile[0] = '\0';    // name of current include file
-
-      loc = 0;
-      for (int i=0; i<16; i++)  // clear section locations
-        sectionLoc[i] = 0;
-      sectI = 0;                // current section
-
-      lineNum = 1;
-      lineNumL68 = 1;
-      endFlag = false;
-      errorCount = warningCount = 0;
-      skipCond = false;             // true conditionally skips lines in code
-      while(!endFlag && fgets(line, 256, inFile)) {
-        error = OK;
-        continuation = false;
-        skipList = false;
-        printCond = false;           // true to print condition on listing line
-        skipCreateCode = false;
-
-        assemble(line, &error);      // assemble one line of code
-        lineNum++;
-      }
+      runPass();
       if (!pass2) {
+        if (relaxRepeat()) {
+          pass = -1;            // repeat pass 1
+          continue;
+        }
         pass2 = true;
         //    ************************************************************
         //    ********************  STARTING PASS 2  *********************
@@ -340,7 +581,6 @@ int processFile()
           printError(listFile, error, lineNum);
         }
       }
-      rewind(inFile);
     }
   }
   catch( ... ) {
@@ -352,25 +592,131 @@ int processFile()
   return NORMAL;
 }
 
+// Return the COND_ value of a line from its tokens
+static unsigned char condOf(tokenSpan tok[])
+{
+  static const char *ifOps[] = { "IFC", "IFNC", "IFEQ", "IFNE",
+                                 "IFLT", "IFLE", "IFGT", "IFGE" };
+  unsigned char cond = COND_NO;
+
+  if (tokenIs(tok[1], "ENDC"))
+    cond = COND_ENDC;
+  else if (!strncmp(tok[1].start, "IF", 2))
+    for (int i=0; i<8; i++)
+      if (tokenIs(tok[1], ifOps[i]))
+        cond = COND_IF;
+  if (cond != COND_NO && tok[0].start != empty)
+    cond |= COND_LABEL;                 // the label is an error
+  return cond;
+}
+
+// Find the matching ENDC of the IFxx in line first of inSource and of
+// each IFxx nested in it, and keep the distance in their lineIR. A block
+// holding a conditional directive with a label is not skipped, so the
+// LABEL_ERROR of the directive is still reported.
+static void findENDC(int first)
+{
+  std::vector<int> open(1, first);      // lines of the open IFxx
+  tokenSpan tok[MAXT];
+  int used = MAXT;
+  lineIR *ir = inSource->ir;
+  char *text;
+
+  for (int i=first+1; i<inSource->lineCount && !open.empty(); i++) {
+    text = inSource->text + inSource->lineStart[i];
+    if (includeNestLevel && (text[0] == '*' || text[1] == '~'))
+      continue;                         // include() does not assemble it
+    if (ir[i].cond == COND_UNKNOWN) {
+      tokenize(inSource->folded + inSource->lineStart[i], COMMA_DELIMS, tok, &used);
+      ir[i].cond = condOf(tok);
+    }
+    if (ir[i].cond == COND_NO)
+      continue;
+    if (ir[i].cond & COND_LABEL)        // not skipped by the open blocks
+      for (size_t j=0; j<open.size(); j++)
+        if (j < open.size() - 1 || (ir[i].cond & ~COND_LABEL) == COND_IF)
+          ir[open[j]].skip = -1;
+    if ((ir[i].cond & ~COND_LABEL) == COND_IF)
+      open.push_back(i);
+    else {                              // ENDC
+      if (ir[open.back()].skip == 0)
+        ir[open.back()].skip = i - open.back();
+      open.pop_back();
+    }
+  }
+  for (size_t j=0; j<open.size(); j++)  // no ENDC, skip to the end
+    if (ir[open[j]].skip == 0)
+      ir[open[j]].skip = inSource->lineCount - open[j];
+}
+
+// The IFxx of the source line with lineIR ir is false. Move to its ENDC,
+// listing the comments in the skipped lines as assemble() would.
+static void skipBlock(lineIR *ir)
+{
+  int n;
+  char *text;
+
+  if (ir->skip == 0)
+    findENDC(ir - inSource->ir);
+  if (ir->skip < 0)
+    return;
+  n = ir->skip - 1;                     // lines between IFxx and ENDC
+  if (pass2 && listFlag)
+    for (int i=inLine; i<inLine+n; i++) {
+      text = inSource->text + inSource->lineStart[i];
+      if (includeNestLevel && (text[0] == '*' || text[1] == '~'))
+        continue;
+      listLoc();
+      char *p = skipSpace(inSource->folded + inSource->lineStart[i]);
+      if (*p == '*' || *p == ';') {     // if comment
+        continuation = false;
+        listLine(text, lineIdent);
+      }
+    }
+  inLine += n;
+  lineNum += n;
+}
+
 // Conditionally Assemble one line of code
 int assemble(char *line, int *errorPtr)
 {
   int value = 0;
   bool backRef = false;
   int error2Ptr = 0;
-  char capLine[256];
+  char capBuffer[256];
+  std::vector<char> capLong;
+  char *capLine = capBuffer;
   char *p;
+  int len;
   bool comment;                   // true when line is comment
+  bool sourceLine = (line == ::line);  // true when line is the source line
+  lineIR *ir = (sourceLine) ? curIR : NULL;  // what is known about the line
+  bool skipping = skipCond;       // true if lines were skipped before this one
 
   try {
 
     if (pass2 && listFlag)
       listLoc();
 
-    strcap(capLine, line);
+    if (ir)                             // line of a source file
+      capLine = inSource->folded + (line - inSource->text);
+    else {
+      len = strlen(line);
+      if (len >= (int) sizeof(capBuffer)) {  // if line is too long for capBuffer
+        capLong.resize(len + 1);
+        capLine = capLong.data();
+      }
+      strcap(capLine, line);
+    }
     p = skipSpace(capLine);  
-    char tempChar[] = ", \t\n";             // skip leading white space
-    tokenize(capLine, tempChar, token, tokens); // tokenize line
+    if (ir && ir->cond == COND_NO) {    // no conditional directive, skip tokenize
+      token[1].start = empty;
+      token[1].length = 0;
+    } else {
+      tokenize(capLine, COMMA_DELIMS, token, &tokenUsed); // tokenize line
+      if (ir)                           // IFxx and ENDC
+        ir->cond = condOf(token);
+    }
     if (*p == '*' || *p == ';')         // if comment
       comment = true;
     else
@@ -385,13 +731,13 @@ int assemble(char *line, int *errorPtr)
     // conditional assembly for all code
 
     // ----- IFC -----
-    if(!(strcasecmp(token[1], "IFC"))) {       // if IFC opcode
-      if (token[0] != empty)                // if label present
+    if(tokenIs(token[1], "IFC")) {       // if IFC opcode
+      if (token[0].start != empty)                // if label present
         NEWERROR(*errorPtr, LABEL_ERROR);
       if (skipCond)
         nestLevel++;                        // nest level of skip
       else {
-        if (strcasecmp(token[2], token[3])) {  // If IFC strings don't match
+        if (!tokenEqual(token[2], token[3])) {  // If IFC strings don't match
           skipCond = true;                  // conditionally skip lines
           nestLevel++;                      // nest level of skip
         }
@@ -399,16 +745,16 @@ int assemble(char *line, int *errorPtr)
       }
 
     // ----- IFNC -----
-    } else if(!(strcasecmp(token[1], "IFNC"))) { // if IFNC opcode
-      if (token[0] != empty)                  // if label present
+    } else if(tokenIs(token[1], "IFNC")) { // if IFNC opcode
+      if (token[0].start != empty)                  // if label present
         NEWERROR(*errorPtr, LABEL_ERROR);
       if (skipCond)
         nestLevel++;                          // nest level of skip
       else {
-        if (token[3] == empty) {                // if IFNC arguments missing
+        if (token[3].start == empty) {                // if IFNC arguments missing
           NEWERROR(*errorPtr, INVALID_ARG);
         } else {
-          if (!(strcasecmp(token[2], token[3]))) { // if IFNC strings match
+          if (tokenEqual(token[2], token[3])) { // if IFNC strings match
             skipCond = true;                    // conditionally skip lines
             nestLevel++;                        // nest level of skip
           }
@@ -417,16 +763,16 @@ int assemble(char *line, int *errorPtr)
       }
 
     // ----- IFEQ -----
-    } else if(!(strcasecmp(token[1], "IFEQ"))) { // if IFEQ opcode
-      if (token[0] != empty)                  // if label present
+    } else if(tokenIs(token[1], "IFEQ")) { // if IFEQ opcode
+      if (token[0].start != empty)                  // if label present
         NEWERROR(*errorPtr, LABEL_ERROR);
       if (skipCond)
         nestLevel++;                          // nest level of skip
       else {
-        if (token[2] == empty) {                // if argument missing
+        if (token[2].start == empty) {                // if argument missing
           NEWERROR(*errorPtr, INVALID_ARG);
         } else {
-          eval(token[2], &value, &backRef, &error2Ptr);
+          eval(token[2].start, &value, &backRef, &error2Ptr);
           if (error2Ptr < ERRORN && value != 0) { // if not condition
             skipCond = true;                    // conditionally skip lines
             nestLevel++;                        // nest level of skip
@@ -436,16 +782,16 @@ int assemble(char *line, int *errorPtr)
       }
 
     // ----- IFNE -----
-    } else if(!(strcasecmp(token[1], "IFNE"))) {  // if IFNE opcode
-      if (token[0] != empty)                  // if label present
+    } else if(tokenIs(token[1], "IFNE")) {  // if IFNE opcode
+      if (token[0].start != empty)                  // if label present
         NEWERROR(*errorPtr, LABEL_ERROR);
       if (skipCond)
         nestLevel++;                          // nest level of skip
       else {
-        if (token[2] == empty) {                // if argument missing
+        if (token[2].start == empty) {                // if argument missing
           NEWERROR(*errorPtr, INVALID_ARG);
         } else {
-          eval(token[2], &value, &backRef, &error2Ptr);
+          eval(token[2].start, &value, &backRef, &error2Ptr);
           if (error2Ptr < ERRORN && value == 0) { // if not condition
             skipCond = true;                    // skip lines in macro
             nestLevel++;                        // nest level of skip
@@ -455,16 +801,16 @@ int assemble(char *line, int *errorPtr)
       }
 
     // ----- IFLT -----
-    } else if(!(strcasecmp(token[1], "IFLT"))) {  // if IFLT opcode
-      if (token[0] != empty)                  // if label present
+    } else if(tokenIs(token[1], "IFLT")) {  // if IFLT opcode
+      if (token[0].start != empty)                  // if label present
         NEWERROR(*errorPtr, LABEL_ERROR);
       if (skipCond)
         nestLevel++;                          // nest level of skip
       else {
-        if (token[2] == empty) {                // if argument missing
+        if (token[2].start == empty) {                // if argument missing
           NEWERROR(*errorPtr, INVALID_ARG);
         } else {
-          eval(token[2], &value, &backRef, &error2Ptr);
+          eval(token[2].start, &value, &backRef, &error2Ptr);
           if (error2Ptr < ERRORN && value >= 0) { // if not condition
             skipCond = true;                    // conditionally skip lines
             nestLevel++;                        // nest level of skip
@@ -474,16 +820,16 @@ int assemble(char *line, int *errorPtr)
       }
 
     // ----- IFLE -----
-    } else if(!(strcasecmp(token[1], "IFLE"))) {  // if IFLE opcode
-      if (token[0] != empty)                  // if label present
+    } else if(tokenIs(token[1], "IFLE")) {  // if IFLE opcode
+      if (token[0].start != empty)                  // if label present
         NEWERROR(*errorPtr, LABEL_ERROR);
       if (skipCond)
         nestLevel++;                          // nest level of skip
       else {
-        if (token[2] == empty) {                // if argument missing
+        if (token[2].start == empty) {                // if argument missing
           NEWERROR(*errorPtr, INVALID_ARG);
         } else {
-          eval(token[2], &value, &backRef, &error2Ptr);
+          eval(token[2].start, &value, &backRef, &error2Ptr);
           if (error2Ptr < ERRORN && value > 0) { // if not condition
             skipCond = true;                    // conditionally skip lines
             nestLevel++;                        // nest level of skip
@@ -493,16 +839,16 @@ int assemble(char *line, int *errorPtr)
       }
 
     // ----- IFGT -----
-    } else if(!(strcasecmp(token[1], "IFGT"))) {  // if IFGT opcode
-      if (token[0] != empty)                  // if label present
+    } else if(tokenIs(token[1], "IFGT")) {  // if IFGT opcode
+      if (token[0].start != empty)                  // if label present
         NEWERROR(*errorPtr, LABEL_ERROR);
       if (skipCond)
         nestLevel++;                          // nest level of skip
       else {
-        if (token[2] == empty) {                // if argument missing
+        if (token[2].start == empty) {                // if argument missing
           NEWERROR(*errorPtr, INVALID_ARG);
         } else {
-          eval(token[2], &value, &backRef, &error2Ptr);
+          eval(token[2].start, &value, &backRef, &error2Ptr);
           if (error2Ptr < ERRORN && value <= 0) { // if not condition
             skipCond = true;                    // conditionally skip lines
             nestLevel++;                        // nest level of skip
@@ -512,16 +858,16 @@ int assemble(char *line, int *errorPtr)
       }
 
     // ----- IFGE -----
-    } else if(!(strcasecmp(token[1], "IFGE"))) {  // if IFGE opcode
-      if (token[0] != empty)                  // if label present
+    } else if(tokenIs(token[1], "IFGE")) {  // if IFGE opcode
+      if (token[0].start != empty)                  // if label present
         NEWERROR(*errorPtr, LABEL_ERROR);
       if (skipCond)
         nestLevel++;                          // nest level of skip
       else {
-        if (token[2] == empty) {                // if argument missing
+        if (token[2].start == empty) {                // if argument missing
           NEWERROR(*errorPtr, INVALID_ARG);
         } else {
-          eval(token[2], &value, &backRef, &error2Ptr);
+          eval(token[2].start, &value, &backRef, &error2Ptr);
           if (error2Ptr < ERRORN && value < 0) {  // if not condition
             skipCond = true;                    // conditionally skip lines
             nestLevel++;                        // nest level of skip
@@ -531,8 +877,8 @@ int assemble(char *line, int *errorPtr)
       }
 
     // ----- ENDC -----
-    } else if(!(strcasecmp(token[1], "ENDC"))) {  // if ENDC opcode
-      if (token[0] != empty)                  // if label present
+    } else if(tokenIs(token[1], "ENDC")) {  // if ENDC opcode
+      if (token[0].start != empty)                  // if label present
         NEWERROR(*errorPtr, LABEL_ERROR);
       if (nestLevel > 0)
         nestLevel--;                          // decrease nesting level
@@ -543,10 +889,18 @@ int assemble(char *line, int *errorPtr)
 
     } else if (!skipCond && !skipCreateCode) {  // else, if not skip condition and not skip create
 
-      createCode(capLine, errorPtr);
+      createCode(capLine, ir, errorPtr);
+      if (objOverlap) {                       // output over earlier output
+        NEWERROR(*errorPtr, OVERLAP);
+        objOverlap = false;
+      }
     }
 
     // display and list errors and source line
+    // MACRO, INCLUDE and macro calls read further lines, the last line
+    // read is the one listed
+    if (sourceLine)
+      line = ::line;
     if (pass2) {
       if (*errorPtr > MINOR)
         errorCount++;
@@ -561,6 +915,10 @@ int assemble(char *line, int *errorPtr)
         listLine(line, lineIdent);
     }
 
+    // a false IFxx of a source file skips to its ENDC at once
+    if (ir && skipCond && !skipping && (ir->cond & ~COND_LABEL) == COND_IF)
+      skipBlock(ir);
+
   }
   catch( ... ) {
     NEWERROR(*errorPtr, EXCEPTION);
@@ -571,51 +929,150 @@ int assemble(char *line, int *errorPtr)
   return NORMAL;
 }
 
+// Register operands are found from the text alone, so they are kept in
+// the lineIR. Any other operand may depend on a symbol and is parsed again.
+const int REG_MODES = DnDirect | AnDirect | AnInd | AnIndPost | AnIndPre;
+
+// Fill d with the register operand kept as mode index + 1 and register
+static void regOperand(opDescriptor *d, unsigned char mode, unsigned char reg)
+{
+  memset(d, 0, sizeof(opDescriptor));
+  d->mode = 1 << (mode - 1);
+  d->reg = reg;
+  d->fix = -1;
+}
+
+//-------------------------------------------------------
+// Build instruction inst from flavor f of the instruction
+static void runFlavor(const instruction *inst, unsigned char f, int size,
+                      opDescriptor *source, opDescriptor *dest, int *errorPtr)
+{
+  const instDispatch *dispatch = instDispatchFor(inst);
+  unsigned short mask;
+
+  if (f != NOFLAVOR) {
+    mask = dispatch->mask[f][size];
+    if (dispatch->badSize[f] & (1 << size))
+      NEWERROR(*errorPtr, INV_SIZE_CODE);
+    // The following line calls the function defined for the current
+    // instruction as a flavor in instTable[]
+    (*inst->flavorPtr[f].exec)(mask, size, source, dest, errorPtr);
+    return;
+  }
+  NEWERROR(*errorPtr, INV_ADDR_MODE);
+}
+
+//-------------------------------------------------------
+// Build instruction inst from operands that are already parsed, as
+// createCode() does for a line without a label. dest is NULL if there is
+// no destination operand. Used for the code of structured statements.
+void assembleInst(const instruction *inst, int size, opDescriptor *source,
+                  opDescriptor *dest, int *errorPtr)
+{
+  const instDispatch *dispatch = instDispatchFor(inst);
+  opDescriptor none;
+  unsigned char f = 0;
+
+  if (loc & 1) {                // instructions start at a word boundary
+    loc++;
+    listLoc();
+  }
+  if (!dispatch->zeroOp) {
+    f = dispatch->noDest[modeIndex(source->mode)];
+    if (f != NOFLAVOR) {          // flavor without destination
+      if (inst->flavorPtr[f].source && dest) {
+        NEWERROR(*errorPtr, SYNTAX);
+        return;
+      }
+    } else if (dispatch->destFlavor != NOFLAVOR) {
+      if (!dest) {
+        NEWERROR(*errorPtr, COMMA_EXPECTED);
+        return;
+      }
+      f = dispatch->withDest[modeIndex(source->mode)][modeIndex(dest->mode)];
+    }
+  }
+  runFlavor(inst, f, size, source, (dest) ? dest : &none, errorPtr);
+}
+
 // create machine code for instruction
-int createCode(char *capLine, int *errorPtr) {
-  instruction *tablePtr;
-  flavor *flavorPtr;
+// ir, if not NULL, holds what is known about the text of the line from
+// an earlier assembly of it and receives what is learned now.
+int createCode(char *capLine, lineIR *ir, int *errorPtr) {
+  const instruction *tablePtr;
+  const instDispatch *dispatch;
+  const flavor *flavorPtr;
   opDescriptor source, dest;
-  char *p, *start, label[SIGCHARS+1], size, f;
-  bool sourceParsed, destParsed;
-  unsigned short mask, i;
+  char *p, *start, label[SIGCHARS+1], size;
+  unsigned char f;
+  unsigned short i;
 
   
 
   p = start = skipSpace(capLine);  // skip leading spaces and tabs
   if (*p && *p != '*' && *p != ';') {  // if line not empty and not comment
-    // if first char is not alpha . or _
-    if( !isalpha(*p) && *p != '.' && *p != '_')
-      NEWERROR(*errorPtr,ILLEGAL_SYMBOL);
-    // assume the line starts with a label
-    i = 0;
-    do {
-      if (i < SIGCHARS)         // only first SIGCHARS of label are used
-        label[i++] = *p;
-      p++;
-    } while (isalnum(*p) || *p == '.' || *p == '_' || *p == '$');
-    label[i] = '\0';            // end label string with null
-    if (i >= SIGCHARS)
-      NEWERROR(*errorPtr, LABEL_TOO_LONG);
-
-    // if next character is space AND the label was at the start of the line
-    // OR the label ends with ':'
-    if ((isspace(*p) && start == capLine) || *p == ':') {
-      if (*p == ':')            // if label ends with :
-        p++;                    // skip it
-      p = skipSpace(p);         // skip trailing spaces
-      if (*p == '*' || *p == ';' || !*p) {   // if the next char is '*' or ';' or end of line
+    if (ir && ir->state != LINE_NEW) {  // if label and opcode are known
+      memcpy(label, start, ir->labelLength);
+      label[ir->labelLength] = '\0';
+      NEWERROR(*errorPtr, ir->error);
+      if (ir->state == LINE_LABEL) {
         define(label, loc, pass2, true, errorPtr);  // add label to list of labels
         return NORMAL;
       }
+      tablePtr = ir->inst;
+      size = ir->size;
+      p = capLine + ir->operand;
     } else {
-      p = start;                // reset p to start of line
-      label[0] = '\0';          // clear label
+      // if first char is not alpha . or _
+      if( !isalpha(*p) && *p != '.' && *p != '_')
+        NEWERROR(*errorPtr,ILLEGAL_SYMBOL);
+      // assume the line starts with a label
+      i = 0;
+      do {
+        if (i < SIGCHARS)         // only first SIGCHARS of label are used
+          label[i++] = *p;
+        p++;
+      } while (isalnum(*p) || *p == '.' || *p == '_' || *p == '$');
+      label[i] = '\0';            // end label string with null
+      if (i >= SIGCHARS)
+        NEWERROR(*errorPtr, LABEL_TOO_LONG);
+
+      // if next character is space AND the label was at the start of the line
+      // OR the label ends with ':'
+      if ((isspace(*p) && start == capLine) || *p == ':') {
+        if (*p == ':')            // if label ends with :
+          p++;                    // skip it
+        p = skipSpace(p);         // skip trailing spaces
+        if (*p == '*' || *p == ';' || !*p) {   // if the next char is '*' or ';' or end of line
+          if (ir) {
+            ir->state = LINE_LABEL;
+            ir->labelLength = i;
+            ir->error = *errorPtr;
+          }
+          define(label, loc, pass2, true, errorPtr);  // add label to list of labels
+          return NORMAL;
+        }
+      } else {
+        p = start;                // reset p to start of line
+        label[0] = '\0';          // clear label
+      }
+      p = instLookup(p, &tablePtr, &size, errorPtr);
+      if (*errorPtr > SEVERE)
+        return NORMAL;
+      p = skipSpace(p);
+      // A macro call sets macroIndex and a bitfield instruction depends on
+      // BITflag, so they are looked up every time.
+      if (ir && tablePtr->exec != asmMacro &&
+          !(tablePtr->flavorPtr && tablePtr->flavorPtr->exec == bitField)) {
+        ir->state = LINE_CODE;
+        ir->inst = tablePtr;
+        ir->size = size;
+        ir->operand = p - capLine;
+        ir->labelLength = strlen(label);
+        ir->error = *errorPtr;
+      } else
+        ir = NULL;
     }
-    p = instLookup(p, &tablePtr, &size, errorPtr);
-    if (*errorPtr > SEVERE)
-      return NORMAL;
-    p = skipSpace(p);
     if (tablePtr->parseFlag) {
       // Move location counter to a word boundary and fix
       //   the listing before assembling an instruction
@@ -627,25 +1084,42 @@ int createCode(char *capLine, int *errorPtr) {
         define(label, loc, pass2, true, errorPtr);
       if (*errorPtr > SEVERE)
         return NORMAL;
-      sourceParsed = destParsed = false;
+      // The flavor is found in the dispatch table of the instruction
+      // by the addressing modes of the operands
+      dispatch = instDispatchFor(tablePtr);
       flavorPtr = tablePtr->flavorPtr;
-      for (f = 0; (f < tablePtr->flavorCount); f++, flavorPtr++) {
-        if (!sourceParsed && flavorPtr->source) {
-          p = opParse(p, &source, errorPtr);    // parse source
+      f = 0;
+      if (!dispatch->zeroOp) {
+        if (ir && ir->srcMode) {        // if register source is known
+          regOperand(&source, ir->srcMode, ir->srcReg);
+          p = capLine + ir->srcEnd;
+        } else {
+          p = opParse(p, &source, errorPtr);      // parse source
           if (*errorPtr > SEVERE)
             return NORMAL;
+          if (ir && (source.mode & REG_MODES)) {
+            ir->srcMode = modeIndex(source.mode) + 1;
+            ir->srcReg = source.reg;
+            ir->srcEnd = p - capLine;
+          }
+        }
 
-          if (flavorPtr && flavorPtr->exec == bitField) {     // if bitField instruction
-            p = skipSpace(p);           // skip spaces after source operand
-            if (*p != ',') {            // if not Dn,addr{offset:width}
-              p = fieldParse(p, &source, errorPtr);     // parse {offset:width}
-              if (*errorPtr > SEVERE)
-                return NORMAL;
-            }
+        if (dispatch->srcField) {       // if bitField instruction
+          p = skipSpace(p);             // skip spaces after source operand
+          if (*p != ',') {              // if not Dn,addr{offset:width}
+            p = fieldParse(p, &source, errorPtr);       // parse {offset:width}
+            if (*errorPtr > SEVERE)
+              return NORMAL;
           }
-          sourceParsed = true;
         }
-        if (!destParsed && flavorPtr->dest) {   // if destination needs parsing
+        f = dispatch->noDest[modeIndex(source.mode)];
+        if (f != NOFLAVOR) {            // flavor without destination
+          if (flavorPtr[f].source && *p!='{' && !isspace(*p) && *p) {
+            NEWERROR(*errorPtr, SYNTAX);
+            return NORMAL;
+          }
+        }
+        else if (dispatch->destFlavor != NOFLAVOR) {    // if destination needs parsing
           p = skipSpace(p);     // skip spaces after source operand
           if (*p != ',') {
             NEWERROR(*errorPtr, COMMA_EXPECTED);
@@ -653,12 +1127,21 @@ int createCode(char *capLine, int *errorPtr) {
           }
           p++;                   // skip over comma
           p = skipSpace(p);      // skip spaces before destination operand
-          p = opParse(p, &dest, errorPtr);      // parse destination
-          if (*errorPtr > SEVERE)
-            return NORMAL;
+          if (ir && ir->destMode) {     // if register destination is known
+            regOperand(&dest, ir->destMode, ir->destReg);
+            p = capLine + ir->destEnd;
+          } else {
+            p = opParse(p, &dest, errorPtr);      // parse destination
+            if (*errorPtr > SEVERE)
+              return NORMAL;
+            if (ir && (dest.mode & REG_MODES)) {
+              ir->destMode = modeIndex(dest.mode) + 1;
+              ir->destReg = dest.reg;
+              ir->destEnd = p - capLine;
+            }
+          }
 
-          if (flavorPtr && flavorPtr->exec == bitField &&
-              flavorPtr->source == DnDirect)  // if bitField instruction Dn,addr{offset:width}
+          if (dispatch->destField)      // if bitField instruction Dn,addr{offset:width}
           {
             p = skipSpace(p);           // skip spaces after destination operand
             if (*p != '{') {
@@ -674,37 +1157,10 @@ int createCode(char *capLine, int *errorPtr) {
             NEWERROR(*errorPtr, SYNTAX);
             return NORMAL;
           }
-          destParsed = true;
-        }
-        if (!flavorPtr->source) {
-          mask = pickMask( (int) size, flavorPtr, errorPtr);
-          // The following line calls the function defined for the current
-          // instruction as a flavor in instTable[]
-          (*flavorPtr->exec)(mask, (int) size, &source, &dest, errorPtr);
-          return NORMAL;
-        }
-        else if ((source.mode & flavorPtr->source) && !flavorPtr->dest) {
-          if (*p!='{' && !isspace(*p) && *p) {
-            NEWERROR(*errorPtr, SYNTAX);
-            return NORMAL;
-          }
-          mask = pickMask( (int) size, flavorPtr, errorPtr);
-          // The following line calls the function defined for the current
-          // instruction as a flavor in instTable[]
-          (*flavorPtr->exec)(mask, (int) size, &source, &dest, errorPtr);
-          return NORMAL;
-        }
-        else if (source.mode & flavorPtr->source
-                 && dest.mode & flavorPtr->dest) {
-          mask = pickMask( (int) size, flavorPtr, errorPtr);
-          // The following line calls the function defined for the current
-          // instruction as a flavor in instTable[]
-
-          (*flavorPtr->exec)(mask, (int) size, &source, &dest, errorPtr);
-          return NORMAL;
+          f = dispatch->withDest[modeIndex(source.mode)][modeIndex(dest.mode)];
         }
       }
-      NEWERROR(*errorPtr, INV_ADDR_MODE);
+      runFlavor(tablePtr, f, size, &source, &dest, errorPtr);
     } else {
       // The following line calls the function defined for the current
       // instruction as a flavor in instTable[]
@@ -792,49 +1248,49 @@ char *fieldParse(char *p, opDescriptor *d, int *errorPtr)
   return p;
 }
 
-//-------------------------------------------------------
-int pickMask(int size, flavor *flavorPtr, int *errorPtr)
-{
-  if (!size || size & flavorPtr->sizes)
-    if (size & (BYTE_SIZE | SHORT_SIZE))
-      return flavorPtr->bytemask;
-  else if (!size || size == WORD_SIZE)
-    return flavorPtr->wordmask;
-  else
-    return flavorPtr->longmask;
-  NEWERROR(*errorPtr, INV_SIZE_CODE);
-  return flavorPtr->wordmask;
-}
-
 //---------------------------------------------------
 // Tokenize a string to tokens.
-// Each element of token[] is a pointer to the corresponding token in
-//   tokens. token[0] is always reserved for the label if any. A value
-//   of empty in token[] indicates no token.
-// Each token is null terminated.
+// Each element of token[] is a view of the corresponding token in instr.
+//   The line is not copied or modified, the tokens are not null terminated.
+//   token[0] is always reserved for the label if any. A start of empty
+//   in token[] indicates no token.
 // Items inside parenthesis (  ) are one token
 // Items inside single quotes ' ' are one token
+// An argument that starts with '' is an empty token of length 0
 // Parameters:
 //      instr = the string to tokenize
-//      delim = string of delimiter characters
-//              (spaces are not default delimiters)
+//      delims = COMMA_DELIMS, SPACE_DELIMS or DOT_DELIMS, the set of
+//              delimiter characters (spaces are not default delimiters)
 //              period delimiters are included in the start of the next token
-//      token[] = pointers to tokens
-//      tokens = new string full of tokens
+//      token[] = views of the tokens
+//      used = if not NULL, the number of slots of token[] that may be
+//             set from the previous call with the same token[]. Only
+//             those slots are cleared and the number is updated.
 // Returns number of tokens extracted.
-int tokenize(char* instr, char* delim, char *token[], char* tokens){
-  int i, size, tokN = 0, tokCount = 0;
+int tokenize(char* instr, int delims, tokenSpan token[], int *used){
+  static bool isDelim[DELIM_SETS][256]; // true for delimiter characters
+  static bool delimsReady = false;
+  static const char *delimChars[DELIM_SETS] = { ", \t\n", " \t\n", ". \t\n" };
+  int i, tokN = 0, tokCount = 0;
   char* start;
   int parenCount;
   bool dotDelimiter;
+  bool nullArg;
   bool quoted = false;
+  const bool *delim;
 
-
-  dotDelimiter = (strchr(delim, '.'));  // set true if . is a delimiter
-  // clear token pointers
-  for (i=0; i<MAXT; i++) {
-    token[i] = empty;           // this makes the pointer point to empty
-    tokenEnd[i] = NULL;         // clear positions
+  if (!delimsReady) {                   // fill in the tables once
+    for (int d=0; d<DELIM_SETS; d++)
+      for (i=0; delimChars[d][i]; i++)
+        isDelim[d][(unsigned char) delimChars[d][i]] = true;
+    delimsReady = true;
+  }
+  delim = isDelim[delims];
+  dotDelimiter = delim['.'];            // set true if . is a delimiter
+  // clear tokens
+  for (i=0; i<(used ? *used : MAXT); i++) {
+    token[i].start = empty;     // this makes the token point to empty
+    token[i].length = 0;
   }
 
   start = instr;
@@ -843,44 +1299,53 @@ int tokenize(char* instr, char* delim, char *token[], char* tokens){
   if (*instr != '*' && *instr != ';') {         // if not comment line
     if (start != instr)                         // if no label
       tokN = 1;
-    size = 0;
-    while (*instr && tokN < MAXT && size < MAX_SIZE) { // while tokens remain
+    while (*instr && tokN < MAXT) {             // while tokens remain
       parenCount = 0;
-      token[tokN] = &tokens[size];              // pointer to token
-      //while (*instr && strchr(delim, *instr))   // skip leading delimiters
+      nullArg = false;
       while(*instr && isspace(*instr))              // skip leading spaces
         instr++;
       if (*instr == '\'' && *(instr+1) == '\'') { // if argument starts with '' (NULL)
-        tokens[size++] = '\0';
+        nullArg = true;
         instr+=2;
       }
+      start = instr;
       if (dotDelimiter && *instr == '.') {      // if . delimiter
-        tokens[size++] = *instr++;              // start token with .
+        instr++;                                // start token with .
       }
-      // while more chars AND (not delimiter OR inside parens) AND token size limit not reached OR quoted
-      while (*instr && (!(strchr(delim, *instr)) || parenCount > 0 || quoted) && (size < MAX_SIZE-1) ) {
+      // while more chars AND (not delimiter OR inside parens) OR quoted
+      while (*instr && (!delim[(unsigned char) *instr] || parenCount > 0 || quoted)) {
         if (*instr == '\'')                     // if found '
-          if (quoted)
-            quoted = false;
-          else
-            quoted = true;
+          quoted = !quoted;
         if (*instr == '(')                      // if found (
           parenCount++;
         else if (*instr == ')')
           parenCount--;
-        tokens[size++] = *instr++;
+        instr++;
       }
 
-      tokens[size++] = '\0';                    // terminate
-      tokenEnd[tokN] = instr;                   // save token end position in source line
+      token[tokN].start = start;
+      token[tokN].length = (nullArg) ? 0 : instr - start;
       if (*instr && (!dotDelimiter || *instr != '.')) // if not . delimiter
         instr++;                                // skip delimiter
       tokCount++;                               // count tokens
       tokN++;                                   // next token index
-      //while (*instr && strchr(delim, *instr))       // skip trailing delimiters
       while (*instr && isspace(*instr))         // skip trailing spaces *ck 12-10-2005
         instr++;
     }
   }
+  if (used)
+    *used = tokN;
   return tokCount;
 }
+
+// Return true if token t is the string s, ignoring case.
+bool tokenIs(tokenSpan t, const char *s)
+{
+  return strncasecmp(t.start, s, t.length) == 0 && s[t.length] == '\0';
+}
+
+// Return true if tokens a and b are the same string, ignoring case.
+bool tokenEqual(tokenSpan a, tokenSpan b)
+{
+  return a.length == b.length && strncasecmp(a.start, b.start, a.length) == 0;
+}
@@ -0,0 +1,53 @@
+#!/bin/bash
+#
+# Symbol table benchmark. Generates sources with N labels, each followed
+# by a reference to another label before or after it, assembles each one
+# and prints the time per symbol. All labels share a long prefix, which
+# the old first letter buckets handled worst.
+#
+#   bench/symbols.sh [assembler] [N ...]
+#
+# The assembler defaults to ./Rigel68K, N to 1000 10000 100000. The best
+# of 3 runs is shown.
+
+ASM=${1:-./Rigel68K}
+shift
+SIZES=${@:-1000 10000 100000}
+RUNS=3
+
+if [ ! -x "$ASM" ]; then
+    echo "no assembler $ASM, run ./build.sh first" >&2
+    exit 1
+fi
+
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+printf "%8s %10s %12s\n" symbols seconds "us/symbol"
+for N in $SIZES; do
+    SRC=$DIR/sym$N.x68
+    awk -v n=$N 'BEGIN {
+        print " org $1000"
+        for (i = 0; i < n; i++)
+            printf "generated_label_%06d dc.l generated_label_%06d\n", i, (i * 7919 + 1) % n
+        print " end $1000"
+    }' > $SRC
+
+    BEST=
+    for ((r = 0; r < RUNS; r++)); do
+        START=$(date +%s%N)
+        "$ASM" $SRC $DIR/out > /dev/null
+        END=$(date +%s%N)
+        T=$((END - START))
+        if [ -z "$BEST" ] || [ $T -lt $BEST ]; then
+            BEST=$T
+        fi
+    done
+    if ! grep -q "^No errors detected" $DIR/out.L68; then
+        echo "$SRC did not assemble" >&2
+        exit 1
+    fi
+    awk -v n=$N -v t=$BEST 'BEGIN {
+        printf "%8d %10.3f %12.3f\n", n, t / 1e9, t / 1e3 / n
+    }'
+done
@@ -574,18 +574,21 @@ int branch(int mask, int size, opDescriptor *source, opDescriptor *dest,
         (size != LONG_SIZE && size != WORD_SIZE && source->backRef &&
          disp >= -128 && disp <= 127 && disp))
     shortDisp = true;
+  else if (!size && !source->backRef && relaxed(RELAX_BRANCH, source->data))
+    shortDisp = true;           // forward branch shortened by OPT RELAX
   if (pass2) {
     if (shortDisp) {
-      output((int) (mask | (disp & 0xFF)), WORD_SIZE);
+      outputFix(source->fix, FIX_SHORT, loc + 2, (int) (mask | (disp & 0xFF)),
+                WORD_SIZE);
       loc += 2;
-      if (disp < -128 || disp > 127 || !disp)
+      if (source->fix < 0 && (disp < -128 || disp > 127 || !disp))
 	NEWERROR(*errorPtr, INV_BRANCH_DISP);
     } else {
       output((int) (mask), WORD_SIZE);
       loc += 2;
-      output((int) (disp), WORD_SIZE);
+      outputFix(source->fix, FIX_DISP16, loc, (int) (disp), WORD_SIZE);
       loc += 2;
-      if (disp < -32768 || disp > 32767)
+      if (source->fix < 0 && (disp < -32768 || disp > 32767))
 	NEWERROR(*errorPtr, INV_BRANCH_DISP);
     }
   }
@@ -697,9 +700,9 @@ int dbcc(int mask, int size, opDescriptor *source, opDescriptor *dest,
     output((int) (mask | source->reg), WORD_SIZE);
     loc += 2;
     //ck output((int) (disp), WORD_SIZE);
-    output(disp, WORD_SIZE);
+    outputFix(dest->fix, FIX_DISP16, loc, disp, WORD_SIZE);
     loc += 2;
-    if (disp < -32768 || disp > 32767)
+    if (dest->fix < 0 && (disp < -32768 || disp > 32767))
       NEWERROR(*errorPtr, INV_BRANCH_DISP);
   }
   else
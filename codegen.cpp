@@ -14,6 +14,10 @@
  *              is being produced, it calls outputBin() to output the data
  *              in binary form.
  *
+ *		outputFill()
+ *		Outputs a block of copies of the same data, for DCB,
+ *		with one call of listFill() and fillObj().
+ *
  *		effAddr()
  *		Computes the 6-bit effective address code used by the
  *		68000 in most cases to specify address modes. This code
@@ -35,6 +39,9 @@
  *	 Usage: output(data, size)
  *		int data, size;
  *
+ *		outputFill(data, size, count)
+ *		int data, size, count;
+ *
  *		effAddr(operand)
  *		opDescriptor *operand;
  *
@@ -76,45 +83,44 @@ int output(int	data, int size)
   return NORMAL;
 }
 
-
-int effAddr(opDescriptor *operand)
+// Output count copies of data of size starting at loc, as count calls
+// of output() would with loc advanced by size each time
+int outputFill(int data, int size, int count)
 {
+  if (listFlag)
+    listFill(data, size, count);
+  if (objFlag)
+    fillObj(loc, data, size, count);
+  return NORMAL;
+}
 
-  if (operand->mode == DnDirect)
-    return 0x00 | operand->reg;
-
-  if (operand->mode == AnDirect)
-    return 0x08 | operand->reg;
-
-  if (operand->mode == AnInd	  )
-    return 0x10 | operand->reg;
-
-  if (operand->mode == AnIndPost)
-    return 0x18 | operand->reg;
-
-  if (operand->mode == AnIndPre)
-    return 0x20 | operand->reg;
-
-  if (operand->mode == AnIndDisp)
-    return 0x28 | operand->reg;
-
-  if (operand->mode == AnIndIndex)
-    return 0x30 | operand->reg;
-
-  if (operand->mode == AbsShort)
-    return 0x38;
-
-  if (operand->mode == AbsLong)
-    return 0x39;
 
-  if (operand->mode == PCDisp)
-    return 0x3A;
+// Effective address mode and register field by addressing mode index.
+// The register number is added for modes 0 to 6.
+const unsigned char eaCode[NMODES] = {
+  0x00,         // DnDirect
+  0x08,         // AnDirect
+  0x10,         // AnInd
+  0x18,         // AnIndPost
+  0x20,         // AnIndPre
+  0x28,         // AnIndDisp
+  0x30,         // AnIndIndex
+  0x38,         // AbsShort
+  0x39,         // AbsLong
+  0x3A,         // PCDisp
+  0x3B,         // PCIndex
+  0x3C          // IMMEDIATE
+};
 
-  if (operand->mode == PCIndex)
-    return 0x3B;
+int effAddr(opDescriptor *operand)
+{
+  int m = modeIndex(operand->mode);
 
-  if (operand->mode == IMMEDIATE)
-    return 0x3C;
+  if (m <= modeIndex(IMMEDIATE)) {
+    if (eaCode[m] < 0x38)
+      return eaCode[m] | operand->reg;
+    return eaCode[m];
+  }
 
   sprintf(buffer,"INVALID EFFECTIVE ADDRESSING MODE!\n");
   exit (0);
@@ -139,8 +145,9 @@ int extWords(opDescriptor *op, int size, int *errorPtr)
       disp = op->data;
       if (op->mode == PCDisp)
 	disp -= loc;
-      output(disp & 0xFFFF, WORD_SIZE);
-      if (disp < -32768 || disp > 32767)        //CK 3.7.3 undo 2.9.2 change
+      outputFix(op->fix, FIX_DISP16, (op->mode == PCDisp) ? loc : 0,
+                disp & 0xFFFF, WORD_SIZE);
+      if (op->fix < 0 && (disp < -32768 || disp > 32767))  //CK 3.7.3 undo 2.9.2 change
 	NEWERROR(*errorPtr, INV_DISP);
     }
     loc += 2;
@@ -150,16 +157,17 @@ int extWords(opDescriptor *op, int size, int *errorPtr)
       disp = op->data;
       if (op->mode == PCIndex)
 	disp -= loc;
-      output((( (int) (op->size) == LONG_SIZE) ? 0x800 : 0)
+      outputFix(op->fix, FIX_DISP8, (op->mode == PCIndex) ? loc : 0,
+                (( (int) (op->size) == LONG_SIZE) ? 0x800 : 0)
 	        | (op->index << 12) | (disp & 0xFF), WORD_SIZE);
-      if (disp < -128 || disp > 127)            //CK 3.7.3 undo 2.9.2 change
+      if (op->fix < 0 && (disp < -128 || disp > 127))  //CK 3.7.3 undo 2.9.2 change
 	NEWERROR(*errorPtr, INV_DISP);
     }
     loc += 2;
   }
   else if (op->mode == AbsShort) {
     if (pass2) {
-      output(op->data & 0xFFFF, WORD_SIZE);
+      outputFix(op->fix, FIX_DISP16, 0, op->data & 0xFFFF, WORD_SIZE);
       if (op->data < -32768 || op->data > 32767)
 	NEWERROR(*errorPtr, INV_ABS_ADDRESS);
     }
@@ -167,13 +175,13 @@ int extWords(opDescriptor *op, int size, int *errorPtr)
   }
   else if (op->mode == AbsLong) {
     if (pass2)
-      output(op->data, LONG_SIZE);
+      outputFix(op->fix, FIX_LONG, 0, op->data, LONG_SIZE);
     loc += 4;
   }
   else if (op->mode == IMMEDIATE) {
     if (!size || size == WORD_SIZE) {
       if (pass2) {
-	output(op->data & 0xFFFF, WORD_SIZE);
+	outputFix(op->fix, FIX_WORD, 0, op->data & 0xFFFF, WORD_SIZE);
 //	if (op->data > 0xffff)                          // Sep-2008
 //	  NEWERROR(*errorPtr, INV_16_BIT_DATA);         // "
       if (op->data < -32768 || op->data > 65535)        // "
@@ -183,7 +191,7 @@ int extWords(opDescriptor *op, int size, int *errorPtr)
     }
     else if (size == BYTE_SIZE) {
       if (pass2) {
-	output(op->data & 0xFF, WORD_SIZE);
+	outputFix(op->fix, FIX_BYTE, 0, op->data & 0xFF, WORD_SIZE);
 //	if (op->data < -32768 || op->data > 32767)      // Sep-2008
 //	  NEWERROR(*errorPtr, INV_8_BIT_DATA);          // "
 	if (op->data < -128 || op->data > 255)          // "
@@ -194,7 +202,7 @@ int extWords(opDescriptor *op, int size, int *errorPtr)
     }
     else if (size == LONG_SIZE) {
       if (pass2)
-	output(op->data, LONG_SIZE);
+	outputFix(op->fix, FIX_LONG, 0, op->data, LONG_SIZE);
       loc += 4;
     }
   } else {
@@ -39,6 +39,8 @@
 
 #include <stdio.h>
 #include <ctype.h>
+#include <vector>
+#include <sys/stat.h>
 #include "asm.h"
 
 extern int loc;
@@ -63,14 +65,16 @@ extern bool SEXflag;    // true expands structured code
 extern bool WARflag;    // true displays warnings
 extern bool CEXflag;    // true expands constants
 extern bool BITflag;    // True to assemble bitfield instructions
+extern bool RELAXflag;  // true repeats pass 1 to shorten forward references
 extern bool objFlag;	// True if an object code file is desired
 extern int includeNestLevel;    // count nested include directives
 extern char includeFile[256];  // name of current include file
 
-extern char line[256];		// Source line
+extern char *line;		// Source line
 extern int lineNum;
 extern int errorCount, warningCount;
-extern FILE *inFile;            // input source file
+extern sourceFile *inSource;    // input source file
+extern int inLine;              // index of next line of inSource
 extern FILE *listFile;		// Listing file
 extern bool continuation;	// TRUE if the listing line is a continuation
 extern bool skipList;           // true to skip listing line in ASSEMBLE.CPP
@@ -84,6 +88,7 @@ extern bool mapProtected;
 extern int mapProtectedStart, mapProtectedEnd;
 extern bool mapInvalid;
 extern int mapInvalidStart, mapInvalidEnd;
+extern int evalFix;             // fixup expression of last eval(), or -1
 
 /***********************************************************************
  *	ORG directive.
@@ -342,7 +347,8 @@ int dc(int size, char *label, char *op, int *errorPtr)
 {
   int	outVal;
   bool backRef;
-  char string[260], *p;
+  std::vector<char> string;          // string of a DC, as long as the line
+  char *p;
 
   if (size == SHORT_SIZE) {
     NEWERROR(*errorPtr, INV_SIZE_CODE);
@@ -370,12 +376,13 @@ int dc(int size, char *label, char *op, int *errorPtr)
   do {
     p = op;                             // save location of op
     if (*op == '\'') {                  // if string
-      op = collect(++op, string);       // copy to string
+      string.assign(strlen(op) + 4, '\0');      // string and four nulls
+      op = collect(++op, string.data());        // copy to string
       if (!isspace(*op) && *op != ',') { // if stuff after string
         op = p;                         // restore op
         goto notString;                 // ***** GOTO *****
       }
-      p = string;
+      p = string.data();
       while (*p) {
 	outVal = *p++;
 	if (size > BYTE_SIZE)
@@ -400,7 +407,8 @@ notString:                              // process non strings
       //	return NORMAL;
       //}
       if (pass2)
-	output(outVal, size);
+	outputFix(evalFix, (size == BYTE_SIZE) ? FIX_BYTE :
+	          (size == WORD_SIZE) ? FIX_WORD : FIX_LONG, 0, outVal, size);
       loc += size;
       if (size == BYTE_SIZE && (outVal < -128 || outVal > 255)) {
 	NEWERROR(*errorPtr, INV_8_BIT_DATA);
@@ -419,7 +427,8 @@ notString:                              // process non strings
 
 /**********************************************************************
  *	Function collect parses strings for dc. Each output string
- *	is padded with four nulls at the end.
+ *	is padded with four nulls at the end. d must hold the length
+ *	of s plus four characters.
  **********************************************************************/
 
 char *collect(char *s, char *d)
@@ -449,7 +458,7 @@ char *collect(char *s, char *d)
 
 int dcb(int size, char *label, char *op, int *errorPtr)
 {
-  int	blockSize, blockVal, i;
+  int	blockSize, blockVal;
   bool backRef;
 
   if (size == SHORT_SIZE) {
@@ -500,13 +509,10 @@ int dcb(int size, char *label, char *op, int *errorPtr)
     if (pass2) {
       bool CEXsave = CEXflag;
       CEXflag = false;          // prevent display of all DCB data
-      for (i = 0; i < blockSize; i++) {
-        output(blockVal, size);
-	loc += size;
-      }
+      outputFill(blockVal, size, blockSize);
       CEXflag = CEXsave;
-    }else
-      loc += blockSize * size;
+    }
+    loc += blockSize * size;
   }
 
   return NORMAL;
@@ -620,6 +626,8 @@ int opt(int size, char *label, char *op, int *errorPtr)
       CEXflag = true;             // enable constant expansion
     else if ( strcasecmp(option,"NOCEX") == 0)
       CEXflag = false;            // disable constant expansion
+    else if ( strcasecmp(option,"RELAX") == 0)
+      RELAXflag = true;           // shorten forward branches and addresses
     else if ( strcasecmp(option,"BIT") == 0) {
       BITflag = true;             // enable bit field support
       if (pass2 && listFlag) {
@@ -641,19 +649,20 @@ int opt(int size, char *label, char *op, int *errorPtr)
 // }
 int include(int size, char *label, char *fileName, int *errorPtr)
 {
-  char incLine[256], capLine[256];
+  std::vector<char> capLine(strlen(fileName) + 1);
   char *src, *dst;
   int error, i;
   int tempFP;                          // temporary File Pointer
   bool comment;                         // true when line is comment
   int value;
   bool backRef;
-  FILE *incFile;
-  FILE *tmpInFile;                      // save current file
+  sourceFile *incFile;
+  sourceFile *tmpInFile;                // save current file
+  int tmpInLine;
   char quote;
   int lineNumInc;                       // line number for include file
   int lineNumSave;
-  char fileNameSave[256];
+  std::string fileNameSave;
 
   if (size) {                                   // if .size code specified
     NEWERROR(*errorPtr, INV_SIZE_CODE);         // error, invalid size code
@@ -669,11 +678,11 @@ int include(int size, char *label, char *fileName, int *errorPtr)
   if (*label)
     define(label, loc, pass2, true, errorPtr);
 
-  strcap(capLine, fileName);
+  strcap(capLine.data(), fileName);
 
   // strip quotes from filename
-  src = capLine;
-  dst = capLine;
+  src = capLine.data();
+  dst = capLine.data();
   src = skipSpace(src);         // skip leading spaces in filename
   if (*src == '\"' || *src == '\'') {       // *ck 12-9-2005
     quote = *src;
@@ -689,7 +698,7 @@ int include(int size, char *label, char *fileName, int *errorPtr)
 
   // strip whitespace from end of filename
   dst--;
-  while (dst > capLine && isspace(*dst))
+  while (dst > capLine.data() && isspace(*dst))
     dst--;
   dst++;
   *dst = '\0';
@@ -699,15 +708,17 @@ int include(int size, char *label, char *fileName, int *errorPtr)
   }
 
   try {
-    incFile = fopen(capLine, "r");     // attempt to open include file
+    incFile = loadSource(capLine.data());  // read include file or get cached copy
     if (!incFile) {                    // if error opening file
       NEWERROR(*errorPtr, FILE_ERROR);     // error, invalid syntax
       return SEVERE;
     }
-    tmpInFile = inFile;                 // save current input file
-    inFile = incFile;                   // make include file input file
-    strcpy(fileNameSave,includeFile);   // save current include file
-    strcpy(includeFile,capLine);        // save new include file
+    tmpInFile = inSource;               // save current input file
+    tmpInLine = inLine;
+    inSource = incFile;                 // make include file input file
+    inLine = 0;
+    fileNameSave = includeFile;         // save current include file
+    snprintf(includeFile, sizeof(includeFile), "%s", capLine.data());  // save new include file
     lineNumSave = lineNum;              // save current line number
 
     // check to see if the included file is already open
@@ -716,7 +727,7 @@ int include(int size, char *label, char *fileName, int *errorPtr)
     // until END directive or EOF
     includeNestLevel++;                 // count nest level of include directive
     lineNum = 1;
-    while(!endFlag && fgets(line, 256, inFile)) {
+    while(!endFlag && nextLine()) {
       error = OK;
       skipList = false;
       continuation = false;
@@ -726,9 +737,9 @@ int include(int size, char *label, char *fileName, int *errorPtr)
         assemble(line, &error);
         lineNum++;
     }
-    fclose(inFile);
-    inFile = tmpInFile;                 // restore previous input file
-    strcpy(includeFile,fileNameSave);   // restore previous include file
+    inSource = tmpInFile;               // restore previous input file
+    inLine = tmpInLine;
+    snprintf(includeFile, sizeof(includeFile), "%s", fileNameSave.c_str());  // restore previous include file
     lineNum = lineNumSave;              // restore line number
 
     includeNestLevel--;
@@ -754,11 +765,15 @@ int include(int size, char *label, char *fileName, int *errorPtr)
 
 int incbin(int size, char *label, char *fileName, int *errorPtr)
 {
-  char capLine[256];
-  char *src, *dst;
+  std::vector<char> capLine(strlen(fileName) + 1);
+  char *src, *dst, *op;
   FILE *incFile;
   char quote;
-  unsigned char dataByte;
+  const int INCBLOCK = 65536;           // bytes read at once
+  std::vector<unsigned char> data;
+  struct stat info;
+  int offset = 0, length = 0, count, error = OK;
+  bool backRef, whole = true, found;
 
   if (size) {                                   // if .size code specified
     NEWERROR(*errorPtr, INV_SIZE_CODE);         // error, invalid size code
@@ -774,54 +789,96 @@ int incbin(int size, char *label, char *fileName, int *errorPtr)
   if (*label)
     define(label, loc, pass2, true, errorPtr);
 
-  strcap(capLine, fileName);
+  strcap(capLine.data(), fileName);
 
   // strip quotes from filename
-  src = capLine;
-  dst = capLine;
+  src = capLine.data();
+  dst = capLine.data();
   src = skipSpace(src);         // skip leading spaces in filename
   if (*src == '\"' || *src == '\'') {
     quote = *src;
     src++;
   } else
     quote = '\0';
-  while (*src && (*src != ' ' || quote) ) {
+  while (*src && (*src != ' ' || quote) && (*src != ',' || quote)) {
     if (*src == quote)
       break;
     else
       *dst++ = *src++;
   }
+  if (quote && *src == quote)
+    src++;
+  op = fileName + (src - capLine.data());       // operands after the name
 
   // strip whitespace from end of filename
   dst--;
-  while (dst > capLine && isspace(*dst))
+  while (dst > capLine.data() && isspace(*dst))
     dst--;
   dst++;
   *dst = '\0';
 
-  if (pass2 && listFlag) {   // if incbin directive should be listed
-    listLine(line, "\0");
+  // optional offset and length of the part of the file to include
+  if (*op == ',') {
+    op = eval(++op, &offset, &backRef, &error);
+    if (error < SEVERE && !backRef)
+      NEWERROR(error, INV_FORWARD_REF);
+    if (error < SEVERE && *op == ',') {
+      whole = false;
+      op = eval(++op, &length, &backRef, &error);
+      if (error < SEVERE && !backRef)
+        NEWERROR(error, INV_FORWARD_REF);
+    }
+    if (error < SEVERE && (offset < 0 || length < 0))
+      NEWERROR(error, INV_LENGTH);
+  }
+  if (error < SEVERE && !isspace(*op) && *op)
+    NEWERROR(error, SYNTAX);
+  if (error != OK) {
+    NEWERROR(*errorPtr, error);
+    return NORMAL;
   }
 
   try {
-    incFile = fopen(capLine, "rb");    // attempt to open incbin binary file
-    if (!incFile) {                    // if ERROR opening file
+    // the size of the file gives the bytes included
+    found = !stat(capLine.data(), &info) && S_ISREG(info.st_mode);
+    if (found) {
+      if (whole)
+        length = info.st_size - offset;
+      if (offset > info.st_size || length > info.st_size - offset) {
+        NEWERROR(*errorPtr, INV_LENGTH);
+        return NORMAL;
+      }
+    }
+
+    if (pass2 && listFlag) {   // if incbin directive should be listed
+      listLine(line, "\0");
+    }
+    if (!found) {
       NEWERROR(*errorPtr, FILE_ERROR);     // error, invalid syntax
       return SEVERE;
     }
 
-    // loop through every byte of incbin file
-    // read 1 byte of data from file
-    while(fread(&dataByte, 1, 1, incFile) && !feof(incFile)) {
-      // On pass 2, output the block of values directly
-      // to the object and binary files (without putting them in the listing)
-      if (pass2) {
-        if (objFlag)
-          outputObj(loc, dataByte, BYTE_SIZE);
+    // On pass 2, output the bytes directly to the object file (without
+    // putting them in the listing) a block at a time
+    if (pass2 && objFlag && length) {
+      incFile = fopen(capLine.data(), "rb");    // attempt to open incbin binary file
+      if (!incFile) {                    // if ERROR opening file
+        NEWERROR(*errorPtr, FILE_ERROR);     // error, invalid syntax
+        return SEVERE;
+      }
+      data.resize((length < INCBLOCK) ? length : INCBLOCK);
+      fseek(incFile, offset, SEEK_SET);
+      for (count = 0; count < length; ) {
+        int n = fread(data.data(), 1, (length - count < INCBLOCK) ?
+                      length - count : INCBLOCK, incFile);
+        if (n <= 0)
+          break;
+        blockObj(loc + count, data.data(), n);
+        count += n;
       }
-      loc++;            // increment location counter once for each byte in file
+      fclose(incFile);
     }
-    fclose(incFile);
+    loc += length;      // advance location counter past the included bytes
 
     if (pass2 && listFlag) {
       skipList = true;      // don't list INCBIN statement again
@@ -1006,9 +1063,11 @@ int simhalt(int size, char *label, char *op, int *errorPtr)
     //if (listFlag)       // if directive should be listed
     //  listLine(line);
     output(0xFFFF, WORD_SIZE);  // opcode $FFFF $FFFF
+    loc += WORD_SIZE;
     output(0xFFFF, WORD_SIZE);  // opcode $FFFF $FFFF
-  }
-  loc += LONG_SIZE;
+    loc += WORD_SIZE;
+  } else
+    loc += LONG_SIZE;
 
   return NORMAL;
 }
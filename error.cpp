@@ -38,6 +38,7 @@
 extern char buffer[256];  //ck used to form messages for display in windows
 extern char numBuf[20];
 extern bool WARflag;
+extern bool noList;         // true if no listing is wanted (-n)
 extern int lineNumL68;      // listing line number
 extern char includeFile[256];  // name of current include file
 extern bool includedFileError; // true if include error message displayed
@@ -90,6 +91,9 @@ int printError(FILE *outFile, int errorCode, int lineNum)
     case LABEL_TOO_LONG:
       sprintf(buffer, "WARNING: Label too long\n");
       break;
+    case OVERLAP:
+      sprintf(buffer, "WARNING: Code overlaps code output earlier\n");
+      break;
     default :
       if (errorCode < MINOR && errorCode > WARNING)
         sprintf(buffer, "WARNING: No message defined\n");
@@ -121,6 +125,9 @@ int printError(FILE *outFile, int errorCode, int lineNum)
     case NO_ENDM:
       sprintf(buffer, "ERROR: ENDM expected\n");
       break;
+    case NO_ENDR:
+      sprintf(buffer, "ERROR: ENDR expected\n");
+      break;
     case TOO_MANY_ARGS:
       sprintf(buffer, "ERROR: Too many arguments\n");
       break;
@@ -237,8 +244,8 @@ int printError(FILE *outFile, int errorCode, int lineNum)
         sprintf(buffer, "ERROR: No message defined\n");
   } // end switch
 
-  if (outFile)
-    listError(numBuf, buffer);  // add error to listing file
+  if (outFile || noList)
+    listError(numBuf, buffer);  // add error to listing file, or console (-n)
 
   // display error messages in edit window
 
@@ -25,6 +25,16 @@
  *		references or FALSE if at least one symbol is a forward
  *		reference. 
  *
+ *		An expression in a source file is compiled to RPN the
+ *		first time it evaluates without any error or warning,
+ *		and later evaluations of the same text run the RPN. An
+ *		expression that does not evaluate cleanly is always
+ *		parsed, so the errors above are reported as before.
+ *
+ *		In one pass assembly an undefined symbol has the value
+ *		0 and no error, and the expression is kept for a fixup
+ *		in evalFix (see FIXUP.CPP).
+ *
  *	 Usage:	char *eval(p, valuePtr, refPtr, errorPtr)
  *		char *p;
  *		int  *valuePtr;
@@ -54,12 +64,18 @@
 
 #include <stdio.h>
 #include <ctype.h>
+#include <vector>
 #include "asm.h"
 
 extern bool pass2;
 extern int loc;
 extern char buffer[256];  //ck used to form messages for display in windows
 extern char numBuf[20];
+extern symbolDef *globalScope;   // last global label, scope of local labels
+extern sourceFile *inSource;    // current source file
+extern lineIR *curIR;           // lineIR of the source line
+extern int relaxCount;          // pass 1 repeats of OPT RELAX
+extern bool onePass;            // true while assembling in one pass
 
 // Largest number that can be represented in an unsigned int
 //	- MACHINE DEPENDENT
@@ -67,9 +83,255 @@ extern char numBuf[20];
 //ck #define LONGLIMIT 0xFFFFFFFF
 const unsigned int LONGLIMIT = 0xFFFFFFFF;         //ck
 
-#define STACKMAX 5
+// The operator stack only holds operators of rising precedence, so the
+// stacks never need more than one entry per precedence level
+const int STACKMAX = 5;         // highest precedence() + 1
+
+// One step of a compiled expression
+typedef struct {
+	int op;			/* EXPR_CONST, EXPR_LOC, EXPR_SYMBOL, EXPR_NEG,
+				   EXPR_NOT or a binary operator character */
+	int value;		/* Value of EXPR_CONST */
+	symbolDef *symbol;	/* Symbol of EXPR_SYMBOL */
+	} exprStep;
+
+const int EXPR_CONST  = 0x100;
+const int EXPR_LOC    = 0x101;  // * (location counter)
+const int EXPR_SYMBOL = 0x102;
+const int EXPR_NEG    = 0x103;  // unary -
+const int EXPR_NOT    = 0x104;  // unary ~
+
+// An expression compiled to RPN. The compiled expressions of a source
+// line are listed from its lineIR.
+typedef struct exprCode {
+	int offset;		/* Offset of the expression text in its line */
+	int length;		/* Length of the expression text */
+	int count;		/* Number of steps */
+	int depth;		/* Stack entries needed to run it */
+	bool local;		/* True if it uses a local label... */
+	symbolDef *scope;	/*  ...found in this scope */
+	exprStep *code;		/* Steps, stored after the exprCode */
+	struct exprCode *next;	/* Next expression of the line */
+	} exprCode;
+
+// Compiled expressions are allocated from a pool of fixed size blocks
+// that is kept when the cache is cleared, like the symbol table arena.
+const int EXPRBLOCK = 65536;            // bytes per pool block
+
+struct exprBlock {
+  exprBlock *next;
+  double bytes[EXPRBLOCK / sizeof(double)];
+};
+
+exprBlock *exprFirst = NULL;            // first pool block
+exprBlock *exprCurrent = NULL;          // block being allocated from
+int exprUsed = 0;                       // bytes used in current block
+
+std::vector<exprStep> exprRecord;       // steps of the expression being compiled
+bool exprCompile = false;               // true while compiling an expression
+bool exprLocal;                         // true if it uses a local label
+std::vector<int> exprStack;             // stack used by runExpr()
+
+int evalForward = 0;            // undefined symbols found in one pass
+bool evalSet;                   // true if a SET symbol was found
+int evalFix = -1;               // fixup expression of last eval(), or -1
+
+char *evalExpr(char *p, int *valuePtr, bool *refPtr, int *errorPtr);
+
+//----------------------------------------------------------
+// Return size bytes from the expression pool, or NULL if size
+// is larger than a block
+static void *exprAlloc(int size)
+{
+  size = (size + sizeof(double) - 1) & ~(int) (sizeof(double) - 1);
+  if (size > EXPRBLOCK)
+    return NULL;
+  if (!exprCurrent || exprUsed + size > EXPRBLOCK) {
+    exprBlock *b = exprCurrent ? exprCurrent->next : exprFirst;
+    if (!b) {                           // no block left to reuse
+      b = new exprBlock;
+      b->next = NULL;
+      if (exprCurrent)
+        exprCurrent->next = b;
+      else
+        exprFirst = b;
+    }
+    exprCurrent = b;
+    exprUsed = 0;
+  }
+  void *p = (char *) exprCurrent->bytes + exprUsed;
+  exprUsed += size;
+  return p;
+}
+
+// Add a step to the expression being compiled, if any
+static void recordStep(int op, int value, symbolDef *symbol)
+{
+  exprStep step;
+
+  if (exprCompile) {
+    step.op = op;
+    step.value = value;
+    step.symbol = symbol;
+    exprRecord.push_back(step);
+  }
+}
+
+// Run compiled expression code. Returns false, without changing
+// *valuePtr or *refPtr, if the expression must be parsed to report an
+// error (register list symbol or division by zero).
+static bool runExpr(const exprCode *code, int *valuePtr, bool *refPtr)
+{
+  const exprStep *step = code->code;
+  const exprStep *end = step + code->count;
+  int sp = 0;
+  bool backRef = true;
+  int t;
+
+  if ((int) exprStack.size() < code->depth)
+    exprStack.resize(code->depth);
+  int *stack = exprStack.data();
+  for (; step < end; step++) {
+    switch (step->op) {
+      case EXPR_CONST:
+        stack[sp++] = step->value;
+        break;
+      case EXPR_LOC:
+        stack[sp++] = loc;
+        break;
+      case EXPR_SYMBOL:
+        if (step->symbol->flags & (REG_LIST_SYM | OLD_SYM))
+          return false;
+        stack[sp++] = step->symbol->value;
+        if (pass2 && !(step->symbol->flags & BACKREF))
+          backRef = false;
+        break;
+      case EXPR_NEG:
+        stack[sp-1] = -stack[sp-1];
+        break;
+      case EXPR_NOT:
+        stack[sp-1] = ~stack[sp-1];
+        break;
+      default:                  // binary operator
+        sp--;
+        if (doOp(stack[sp-1], stack[sp], step->op, &t) != OK)
+          return false;
+        stack[sp-1] = t;
+    }
+  }
+  *valuePtr = stack[0];
+  *refPtr = backRef;
+  return true;
+}
+
+// Parse the expression at p with evalExpr(). In one pass assembly an
+// expression that uses a symbol not yet defined is kept for a fixup in
+// evalFix, unless it also uses a SET symbol, whose value at the end of
+// the pass may not be the one here; the pass then fails in fixLine().
+static char *parseExpr(char *p, int *valuePtr, bool *refPtr, int *errorPtr)
+{
+  int forward = evalForward;
+  char *end;
+
+  evalSet = false;
+  end = evalExpr(p, valuePtr, refPtr, errorPtr);
+  if (evalForward != forward && end && !evalSet) {
+    evalFix = fixExpr(p, end - p);
+    evalForward = forward;
+  }
+  return end;
+}
 
-char *eval(char	*p, int *valuePtr, bool *refPtr, int *errorPtr)
+// Evaluate the expression at p, see the top of this file.
+// The text of the expression is parsed by evalExpr() unless it is
+// in the current source line and has been compiled.
+char *eval(char *p, int *valuePtr, bool *refPtr, int *errorPtr)
+{
+  exprCode *code, *old;
+  char *end, *text;
+  int error, i, n, sp, forward;
+
+  evalFix = -1;
+  // only expressions in the folded text of the source line are compiled
+  if (*errorPtr > SEVERE || !inSource || !curIR || curIR < inSource->ir ||
+      curIR >= inSource->ir + inSource->lineCount)
+    return parseExpr(p, valuePtr, refPtr, errorPtr);
+  n = curIR - inSource->ir;
+  text = inSource->folded + inSource->lineStart[n];
+  if (p < text || p >= inSource->folded + inSource->lineStart[n+1])
+    return parseExpr(p, valuePtr, refPtr, errorPtr);
+
+  for (old = curIR->expr; old; old = old->next)
+    if (old->offset == p - text) {
+      if ((!old->local || old->scope == globalScope) &&
+          runExpr(old, valuePtr, refPtr))
+        return p + old->length;
+      break;
+    }
+
+  // Parse the expression and compile it if no error or warning occurs.
+  // Errors are combined afterwards; NEWERROR() keeps the first error of
+  // the highest severity either way.
+  error = OK;
+  forward = evalForward;
+  exprRecord.clear();
+  exprCompile = true;
+  exprLocal = false;
+  end = parseExpr(p, valuePtr, refPtr, &error);
+  exprCompile = false;
+  NEWERROR(*errorPtr, error);
+  n = exprRecord.size();
+  // a single number is parsed as fast as it is run, so it is not kept,
+  // nor is an expression with a forward reference in one pass
+  if (!end || error != OK || (n == 1 && exprRecord[0].op != EXPR_SYMBOL) ||
+      evalFix >= 0 || evalForward != forward)
+    return end;
+
+  if (old && old->count >= n)           // compiled in another scope
+    code = old;
+  else {
+    code = (exprCode *) exprAlloc(sizeof(exprCode) + n * sizeof(exprStep));
+    if (!code)
+      return end;
+    code->code = (exprStep *) (code + 1);
+    if (old)
+      old->offset = -1;                 // replaced
+    code->next = curIR->expr;
+    curIR->expr = code;
+  }
+  code->offset = p - text;
+  code->length = end - p;
+  code->count = n;
+  code->local = exprLocal;
+  code->scope = globalScope;
+  code->depth = 1;
+  sp = 0;
+  for (i=0; i<n; i++) {                 // find depth of stack
+    code->code[i] = exprRecord[i];
+    if (exprRecord[i].op == EXPR_CONST || exprRecord[i].op == EXPR_LOC ||
+        exprRecord[i].op == EXPR_SYMBOL)
+      sp++;
+    else if (exprRecord[i].op != EXPR_NEG && exprRecord[i].op != EXPR_NOT)
+      sp--;
+    if (sp > code->depth)
+      code->depth = sp;
+  }
+  return end;
+}
+
+//----------------------------------------------------------
+// Empty the expression pool. The compiled expressions of a source
+// file must not be used after this; clearSources() frees its lineIRs.
+void clearExprCache()
+{
+  exprCurrent = NULL;
+  exprUsed = 0;
+}
+
+//----------------------------------------------------------
+// Parse and evaluate the expression at p, adding its steps to
+// exprRecord if an expression is being compiled.
+char *evalExpr(char *p, int *valuePtr, bool *refPtr, int *errorPtr)
 {
   int	valStack[STACKMAX];
   char	opStack[STACKMAX-1];
@@ -135,6 +397,7 @@ char *eval(char	*p, int *valuePtr, bool *refPtr, int *errorPtr)
         t = valStack[--valPtr];
         i = valStack[--valPtr];
         status = doOp(i, t, opStack[--opPtr], &t);
+        recordStep(opStack[opPtr], 0, NULL);
         if (status != OK) {
           // Report error from doOp
           if (pass2) {
@@ -173,7 +436,7 @@ char *eval(char	*p, int *valuePtr, bool *refPtr, int *errorPtr)
   }
   catch( ... ) {
     NEWERROR(*errorPtr, EXCEPTION);
-    sprintf(buffer, "ERROR: An exception occurred in routine 'eval'. \n");
+    sprintf(buffer, "ERROR: An exception occurred in routine 'evalExpr'. \n");
     return NULL;
   }
 
@@ -201,23 +464,26 @@ char *evalNumber(char *p, int *numberPtr, bool *refPtr, int *errorPtr)
   //ck   * is current address
   if (*p == '*') {
     *numberPtr = loc;
+    recordStep(EXPR_LOC, 0, NULL);
     return ++p;
   }
   else if (*p == '-') {
     /* Evaluate unary minus operator recursively */
     p = evalNumber(++p, &x, refPtr, errorPtr);
     *numberPtr = -x;
+    recordStep(EXPR_NEG, 0, NULL);
     return p;
   }
   else if (*p == '~') {
     /* Evaluate one's complement operator recursively */
     p = evalNumber(++p, &x, refPtr, errorPtr);
     *numberPtr = ~x;
+    recordStep(EXPR_NOT, 0, NULL);
     return p;
   }
   else if (*p == '(') {
     /* Evaluate parenthesized expressions recursively */
-    p = eval(++p, &x, refPtr, errorPtr);
+    p = evalExpr(++p, &x, refPtr, errorPtr);
     if (*errorPtr > SEVERE)
       return NULL;
     else if (*p != ')') {
@@ -241,6 +507,7 @@ char *evalNumber(char *p, int *numberPtr, bool *refPtr, int *errorPtr)
 	x = 16 * x + (*p - '0');
     }
     *numberPtr = x;
+    recordStep(EXPR_CONST, x, NULL);
     return p;
   }
   else if (*p == '%' || *p == '@' || isdigit(*p)) {
@@ -271,6 +538,7 @@ char *evalNumber(char *p, int *numberPtr, bool *refPtr, int *errorPtr)
       p++;
     }
     *numberPtr = x;
+    recordStep(EXPR_CONST, x, NULL);
     return p;
   }
   else if (*p == '\'') {        // if start of string literal
@@ -302,6 +570,7 @@ char *evalNumber(char *p, int *numberPtr, bool *refPtr, int *errorPtr)
     else if (i > 4)
       NEWERROR(*errorPtr, ASCII_TOO_BIG);
     *numberPtr = x;
+    recordStep(EXPR_CONST, x, NULL);
     return p;
   }
   else if (isalpha(*p) || *p == '.' || *p == '_') {  // *ck 12-8-2005
@@ -326,6 +595,11 @@ char *evalNumber(char *p, int *numberPtr, bool *refPtr, int *errorPtr)
          list symbol, then return its value */
       if (!(symbol->flags & REG_LIST_SYM)) {
 	*numberPtr = symbol->value;
+	recordStep(EXPR_SYMBOL, 0, symbol);
+	if (name[0] == '.')
+	  exprLocal = true;
+	if (symbol->flags & REDEFINABLE)
+	  evalSet = true;
 
 	if (pass2)
 	  *refPtr = (symbol->flags & BACKREF);
@@ -334,21 +608,18 @@ char *evalNumber(char *p, int *numberPtr, bool *refPtr, int *errorPtr)
 	*numberPtr = 0;
 	NEWERROR(*errorPtr, REG_LIST_SPEC);
       }
-    else {
-      /* Otherwise return an error */
-      if (pass2) {
-        if( (strncmp(name, ".0", 2)) == 0) {
-          NEWERROR(*errorPtr, ENDI_EXPECTED);
-        } else if( (strncmp(name, ".1", 2)) == 0) {
-          NEWERROR(*errorPtr, ENDW_EXPECTED);
-        } else if( (strncmp(name, ".2", 2)) == 0) {
-          NEWERROR(*errorPtr, ENDF_EXPECTED);
-        } else if( (strncmp(name, ".3", 2)) == 0) {
-          NEWERROR(*errorPtr, REPEAT_EXPECTED);
-        } else {
-          NEWERROR(*errorPtr, UNDEFINED);
-        }
-      }
+    else if (onePass) {
+      /* A symbol defined later in one pass assembly is 0 until
+         its fixup */
+      *numberPtr = 0;
+      evalForward++;
+      *refPtr = false;
+    } else {
+      /* Otherwise return an error, and the value of the symbol in
+         the previous pass 1 as an estimate for OPT RELAX */
+      *numberPtr = (symbol && relaxCount) ? symbol->value : 0;
+      if (pass2)
+        NEWERROR(*errorPtr, UNDEFINED);
       else
         NEWERROR(*errorPtr, INCOMPLETE);
       *refPtr = false;
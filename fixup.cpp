@@ -0,0 +1,338 @@
+/***********************************************************************
+ *
+ *		FIXUP.CPP
+ *		One Pass Assembly for 68000 Assembler
+ *
+ *    Function: fixStart()
+ *		Prepares to assemble the source file in one pass, when
+ *		the -1 option asks for it. The listing is cut off again
+ *		if the pass is not kept.
+ *
+ *		fixExpr()
+ *		Keeps the text of an expression that uses a symbol
+ *		which is not yet defined.
+ *
+ *		outputFix()
+ *		Outputs a field that holds the value of such an
+ *		expression and records where it is listed and its
+ *		address, so the value can be filled in at the end of
+ *		the pass.
+ *
+ *		fixLine()
+ *		Checks a line of the pass. The pass fails when a line
+ *		has an error, uses a forward reference that is not
+ *		output by outputFix() or changes an option.
+ *
+ *		fixFinish()
+ *		Evaluates the kept expressions and fills in their
+ *		fields in the listing and the object code. Returns false,
+ *		discarding the pass, if any check fails; the source
+ *		file is then assembled in two passes.
+ *
+ ************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <string>
+#include <vector>
+
+#include "asm.h"
+#include "proto.h"
+
+extern int loc;			// The assembler's location counter
+extern bool pass2;		// Flag set during second pass
+extern int errorCount;
+extern bool objFlag;		// True if an object code file is desired
+extern lineIR *curIR;		// lineIR of the source line
+extern symbolDef *globalScope;  // last global label, scope of local labels
+extern char buffer[256];  //ck used to form messages for display in windows
+
+extern bool listFlag, CEXflag, BITflag, CREflag, MEXflag, SEXflag, WARflag;
+extern bool RELAXflag, offsetMode, showEqual;
+extern bool mapROM, mapRead, mapProtected, mapInvalid;
+
+extern int listObjAt;           // offset in listing line of last listObj()
+extern int objDataAt;           // address of last outputObj() data
+extern int evalForward;         // forward references found by evalNumber()
+
+// In one pass assembly a symbol that is not yet defined has the value 0
+// and no error. eval() keeps the text of each expression that uses one,
+// and the instruction or directive outputs the field holding its value
+// with outputFix(), which records the position of the field in the
+// listing and its address in the object code. When the pass ends the
+// expressions are evaluated in their scope and location and the fields
+// are filled in.
+// A forward reference used in any other way, for the size of an
+// instruction or the count of DS for example, fails the pass, as does
+// any error. The pass stops at the first such line and two passes are
+// then run as if the one pass never was, so a source that fails near its
+// end costs about three passes. One pass saves at most the cost of pass
+// 1, so it is only tried when asked for with -1.
+
+bool onePass = false;           // true while assembling in one pass
+bool tryOnePass = false;        // true to try one pass first (-1)
+
+struct fixExpression {
+  std::string text;             // text of the expression
+  symbolDef *scope;             // scope of local labels
+  int loc;                      // value of *
+  bool claimed;                 // true if output by outputFix()
+};
+
+struct fixup {
+  int expr;                     // expression of the field
+  int kind;                     // FIX_ kind of field
+  int base;                     // subtracted from value, for displacements
+  int bits;                     // output bits that are not the field
+  int size;                     // BYTE_SIZE, WORD_SIZE or LONG_SIZE output
+};
+
+// A field in the listing or the object code. While the listing line is
+// being built, pos is its offset there.
+struct fixSpot {
+  int fixup;
+  long pos;                     // position in the listing file, or address
+  int digits;                   // hex digits of the field that are shown
+};
+
+// Field mask and range of each FIX_ kind
+static const struct {
+  int mask;
+  int low, high;
+} fixKinds[] = {
+  { 0xFF,        -128,    255     },    // FIX_BYTE
+  { 0xFFFF,      -32768,  65535   },    // FIX_WORD
+  { -1,          INT_MIN, INT_MAX },    // FIX_LONG
+  { 0xFF,        -128,    127     },    // FIX_DISP8
+  { 0xFFFF,      -32768,  32767   },    // FIX_DISP16
+  { 0xFF,        -128,    127     }     // FIX_SHORT, not 0
+};
+
+std::vector<fixExpression> fixExprs;
+std::vector<fixup> fixups;
+std::vector<fixSpot> listSpots;                 // in the listing file
+std::vector<fixSpot> objSpots;                  // in the object code
+std::vector<fixSpot> listPending;               // in the listing line
+int fixClaimed;                 // expressions output by outputFix()
+bool fixFailed;                 // true if the pass cannot be kept
+
+static long listStart;          // listing position at the start of the pass
+
+//--------------------------------------------------------
+// Options that a directive may change. Two passes start their second
+// pass with the options left by the first, so the lines before a change
+// may be listed or assembled with other options than in one pass. The
+// pass fails when the options first differ from those it started with.
+static bool *const fixFlags[] = { &listFlag, &CEXflag, &BITflag, &CREflag,
+  &MEXflag, &SEXflag, &WARflag, &RELAXflag, &offsetMode, &showEqual,
+  &mapROM, &mapRead, &mapProtected, &mapInvalid };
+const int FIXFLAGS = sizeof(fixFlags) / sizeof(fixFlags[0]);
+static bool startFlags[FIXFLAGS];       // options at the start of the pass
+
+//--------------------------------------------------------
+// Start one pass assembly. Returns false if the file must be assembled
+// in two passes instead.
+bool fixStart()
+{
+  if (!tryOnePass)
+    return false;
+  listStart = listPos();
+  for (int i=0; i<FIXFLAGS; i++)
+    startFlags[i] = *fixFlags[i];
+  fixExprs.clear();
+  fixups.clear();
+  listSpots.clear();
+  objSpots.clear();
+  listPending.clear();
+  fixClaimed = 0;
+  fixFailed = false;
+  evalForward = 0;
+  onePass = true;
+  return true;
+}
+
+//--------------------------------------------------------
+// Keep the expression of length characters at p, which uses a symbol
+// that is not yet defined. Returns its number for outputFix().
+int fixExpr(char *p, int length)
+{
+  fixExpression e;
+
+  e.text.assign(p, length);
+  e.scope = globalScope;
+  e.loc = loc;
+  e.claimed = false;
+  fixExprs.push_back(e);
+  return fixExprs.size() - 1;
+}
+
+//--------------------------------------------------------
+// Output data of size as output() does. If fix is not -1, data holds the
+// field of kind of expression fix, whose value less base is filled in
+// at the end of the pass.
+int outputFix(int fix, int kind, int base, int data, int size)
+{
+  fixup f;
+  fixSpot s;
+
+  if (fix < 0)
+    return output(data, size);
+  listObjAt = objDataAt = -1;
+  output(data, size);
+  f.expr = fix;
+  f.kind = kind;
+  f.base = base;
+  f.bits = data & ~fixKinds[kind].mask;
+  f.size = size;
+  if (!fixExprs[fix].claimed) {
+    fixExprs[fix].claimed = true;
+    fixClaimed++;
+  }
+  s.fixup = fixups.size();
+  s.digits = size * 2;
+  fixups.push_back(f);
+  if (listObjAt >= 0) {
+    s.pos = listObjAt;
+    listPending.push_back(s);
+  }
+  if (objDataAt >= 0) {
+    s.pos = objDataAt;
+    objSpots.push_back(s);
+  }
+  return NORMAL;
+}
+
+//--------------------------------------------------------
+// Called by listLine() before the listing line is added to the listing.
+// At most width characters of the line are shown.
+void fixListed(int width)
+{
+  long pos;
+
+  if (listPending.empty())
+    return;
+  pos = listPos();
+  for (unsigned int i=0; i<listPending.size(); i++) {
+    fixSpot &s = listPending[i];
+    if (s.pos + s.digits > width)
+      s.digits = width - s.pos;
+    if (s.digits > 0) {
+      s.pos += pos;
+      listSpots.push_back(s);
+    }
+  }
+  listPending.clear();
+}
+
+//--------------------------------------------------------
+// Called when the listing line is cut at offset, or is started again
+// when offset is 0
+void fixListCut(int offset)
+{
+  unsigned int i, n = 0;
+
+  for (i=0; i<listPending.size(); i++) {
+    fixSpot &s = listPending[i];
+    if (s.pos + s.digits > offset)
+      s.digits = offset - s.pos;
+    if (s.digits > 0)
+      listPending[n++] = s;
+  }
+  listPending.resize(n);
+}
+
+//--------------------------------------------------------
+// Called after each line of the pass. Returns false once the pass
+// cannot be kept.
+bool fixLine()
+{
+  // OPT RELAX sizes forward references from the layout of pass 1
+  if (errorCount || evalForward || fixClaimed != (int) fixExprs.size() ||
+      RELAXflag)
+    fixFailed = true;
+  for (int i=0; i<FIXFLAGS; i++)
+    if (*fixFlags[i] != startFlags[i])
+      fixFailed = true;
+  return !fixFailed;
+}
+
+//--------------------------------------------------------
+// Fill in the hex digits of spot s of fixup values in the listing
+static void fixPatch(const fixSpot &s, const std::vector<int> &values)
+{
+  char hex[10];
+  int size = fixups[s.fixup].size;
+
+  // output() writes only size bytes of its data
+  sprintf(hex, "%0*X", size * 2, (size == LONG_SIZE) ? values[s.fixup] :
+          values[s.fixup] & ((1 << size * 8) - 1));
+  listPatch(s.pos, hex, s.digits);
+}
+
+//--------------------------------------------------------
+// End one pass assembly. balanced is false if a conditional or a
+// structured statement is left open, which the second of two passes
+// would see. Returns true if the pass is kept and its fields are filled
+// in. Otherwise its output is removed, the options it started with are
+// restored and the file must be assembled in two passes.
+bool fixFinish(bool balanced)
+{
+  std::vector<int> values;
+  symbolDef *scope = globalScope;
+  int saveLoc = loc;
+  int value, error, field;
+  bool backRef, ok;
+  unsigned int i;
+
+  try {
+    onePass = false;
+    ok = fixLine() && balanced;
+    if (ok) {
+      curIR = NULL;             // evaluate the saved text
+      for (i=0; ok && i<fixups.size(); i++) {
+        fixup &f = fixups[i];
+        fixExpression &e = fixExprs[f.expr];
+        globalScope = e.scope;
+        loc = e.loc;
+        error = OK;
+        eval(&e.text[0], &value, &backRef, &error);
+        field = value - f.base;
+        if (error != OK || field < fixKinds[f.kind].low ||
+            field > fixKinds[f.kind].high ||
+            (f.kind == FIX_SHORT && !field))
+          ok = false;
+        values.push_back((field & fixKinds[f.kind].mask) | f.bits);
+      }
+      globalScope = scope;
+      loc = saveLoc;
+    }
+
+    if (ok) {
+      for (i=0; i<listSpots.size(); i++)
+        fixPatch(listSpots[i], values);
+      for (i=0; i<objSpots.size(); i++)
+        patchObj(objSpots[i].pos, values[objSpots[i].fixup],
+                 fixups[objSpots[i].fixup].size);
+    } else {
+      listCut(listStart);
+      if (objFlag)
+        clearObj();
+      for (int j=0; j<FIXFLAGS; j++)
+        *fixFlags[j] = startFlags[j];
+    }
+    fixExprs.clear();
+    fixups.clear();
+    listSpots.clear();
+    objSpots.clear();
+    listPending.clear();
+    return ok;
+  }
+  catch( ... ) {
+    sprintf(buffer, "ERROR: An exception occurred in routine 'fixFinish'. \n");
+    printError(NULL, EXCEPTION, 0);
+    return false;
+  }
+}
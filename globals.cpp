@@ -39,21 +39,26 @@ char numBuf[20];        // "
 int errorCount, warningCount;	// Number of errors and warnings
 char empty[] = "";      // empty string, used in conditional assembly
 unsigned int startAddress;     // starting address of program
-char globalLabel[SIGCHARS+1];   // used to build unique global label from local label
+symbolDef *globalScope;   // last global label, scope of local labels
 int includeNestLevel;    // count nested include directives
 char includeFile[256];  // name of current include file
 bool includedFileError; // true if include error message displayed
 
 // File pointers
-FILE *inFile;		// Input file
+sourceFile *inSource;	// Input file
+int inLine;		// index of next line of inSource
+lineIR *curIR;		// lineIR of the source line, NULL if none
 FILE *listFile;		// Listing file
 FILE *objFile;		// Object file (S-Record)
 FILE *binFile;          //ck Object file (Binary)
-FILE *tmpFile;          //ck temp file
+FILE *hexFile;          // Object file (Intel HEX)
 FILE *errFile;          //ck Error messages file (text)
 
 // Listing information
-char line[256];		// Source line
+char lineStorage[256];	// initial line buffer
+char *lineBuffer = lineStorage;	// lines built by macros
+int lineSize = sizeof(lineStorage);	// size of lineBuffer
+char *line = lineBuffer;	// Source line
 int lineNum;		// source line number
 int lineNumL68;		// listing line number
 char *listPtr;		// Pointer to buffer where a listing line is assembled
@@ -61,13 +66,17 @@ bool continuation;	// TRUE if the listing line is a continuation
 
 // Option flags
 bool listFlag = 1;	        // True if a listing is desired
-bool objFlag = 1;	        // True if an S-Record object code file is desired
+bool objFlag = 1;	        // True if an object code file is desired
+bool s68Flag = 1;	        // True if an S-Record object code file is desired
+bool binFlag = 0;	        // True if a binary object code file is desired
+bool hexFlag = 0;	        // True if an Intel HEX object code file is desired
 bool CEXflag = 1;	        // True is Constants are to be EXpanded
 bool BITflag = 1;           // True to assemble bitfield instructions
 bool CREflag = 1;           // true adds symbol table to listing
 bool MEXflag = 1;           // true expands macro calls in listing
 bool SEXflag = 1;           // true expands structured code in listing
 bool WARflag  = 1;           // true shows Warnings during assembly
+bool RELAXflag = 0;         // true repeats pass 1 to shorten forward references
 bool noFileName = 1;        // true indicates no name for current source file
 
 // Editor flags
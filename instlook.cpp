@@ -8,10 +8,11 @@
  *		table. The input to the function is a pointer to the
  *		instruction on a line of assembly code. The routine 
  *		scans the instruction and notes the size code if 
- *		present. It then (binary) searches the instruction 
- *		table for the specified opcode. If it finds the opcode, 
- *		it returns a pointer to the instruction table entry for 
- *		that instruction (via the instPtrPtr argument) as well 
+ *		present. It then looks up the opcode in the instruction 
+ *		table through a perfect hash of the mnemonics. If it 
+ *		finds the opcode, it returns a pointer to the 
+ *		instruction table entry for that instruction (via 
+ *		the instPtrPtr argument) as well 
  *		as the size code or 0 if no size was specified (via the 
  *		sizePtr argument). If the opcode is not in the 
  *		instruction table, then the routine returns INV_OPCODE. 
@@ -20,7 +21,7 @@
  *
  *	 Usage:	char *instLookup(p, instPtrPtr, sizePtr, errorPtr)
  *		char *p;
- *		instruction *(*instPtrPtr);
+ *		const instruction *(*instPtrPtr);
  *		char *sizePtr;
  *		int *errorPtr;
  *
@@ -47,9 +48,7 @@
 #include "asm.h"
 
 
-extern instruction instTable[];
-extern int tableSize;
-extern int macroFP;            // location of macro in input file
+extern int macroIndex;         // number of macro, see MACRO.CPP
 extern char buffer[256];  //ck used to form messages for display in windows
 extern char numBuf[20];
 extern bool BITflag;
@@ -57,20 +56,25 @@ extern bool pass2;
 
 char macroAsm[] = "ASMMACRO";
 
-instruction asmMac = { macroAsm, NULL, 0, false, asmMacro };
+const instruction asmMac = { macroAsm, NULL, 0, false, asmMacro };
 
-char *instLookup(char *p, instruction *(*instPtrPtr), char *sizePtr, int *errorPtr)
+char *instLookup(char *p, const instruction *(*instPtrPtr), char *sizePtr, int *errorPtr)
 {
   char opcode[SIGCHARS+1];
-  int i, hi, lo, mid, cmp;
+  int i;
+  unsigned int h;
+  const instruction *instPtr;
   symbolDef *symbol;
 
   try {
     /*	printf("InstLookup: Input string is \"%s\"\n", p); */
     i = 0;
+    h = FNV_BASIS;              // hash opcode while copying it
     do {
-      if (i < SIGCHARS)
+      if (i < SIGCHARS) {
         opcode[i++] = *p;
+        h = (h ^ (unsigned char) *p) * FNV_PRIME;
+      }
       p++;
     } while (isalnum(*p) || *p == '_' || *p == '-');
     opcode[i] = '\0';
@@ -100,40 +104,31 @@ char *instLookup(char *p, instruction *(*instPtrPtr), char *sizePtr, int *errorP
     else
       *sizePtr = 0;
 
-    lo = 0;
-    hi = tableSize - 1;
-
     // search for opcode in instTable
-    do {
-      mid = (hi + lo) / 2;
-      cmp = strcmp(opcode, instTable[mid].mnemonic);
-      if (cmp > 0)
-        lo = mid + 1;
-      else if (cmp < 0)
-        hi = mid - 1;
-    } while (cmp && (hi >= lo));
+    instPtr = instFind(opcode, i, h);
 
     // if opcode found
-    if (!cmp) {
+    if (instPtr) {
       // if bitfield instruction and BITflag is false
-      if (instTable[mid].flavorPtr &&
-          instTable[mid].flavorPtr->exec == bitField && !BITflag) {
+      if (instPtr->flavorPtr &&
+          instPtr->flavorPtr->exec == bitField && !BITflag) {
         NEWERROR(*errorPtr, INV_OPCODE);        // error invalid opcode
         return NULL;
       }
-      *instPtrPtr = &instTable[mid];
+      *instPtrPtr = instPtr;
       return p;
 
     // else, opcode not found
     } else {
 
-      // search for matching macro definition in symbol table
-      symbol = lookup(opcode, false, errorPtr);
-      if ( (*errorPtr < ERRORN) && (symbol->flags & MACRO_SYM) ) { // if found
+      // search for matching macro definition in macro table
+      symbol = macroLookup(opcode, i, h);
+      if ( (*errorPtr < ERRORN) && symbol && (symbol->flags & MACRO_SYM) &&
+           !(symbol->flags & OLD_SYM) ) { // if found
         if(pass2 && !(symbol->flags & BACKREF))  // if forward reference
           NEWERROR(*errorPtr, FORWARD_REF);     // warning
         *instPtrPtr = &asmMac;    // point to asmMac function description
-        macroFP = symbol->value;  // get file pointer to macro
+        macroIndex = symbol->value;  // get number of macro
         return p;                 // return pointer to macro parameters
       } else {
 
@@ -34,8 +34,9 @@
      The procedure which instLookup() and assemble() use to look up
 and verify an instruction (or directive) is as follows. Once the
 mnemonic of the instruction has been parsed and stripped of its size
-code and trailing spaces, the instLookup() does a binary search on the
-instruction table to determine if the mnemonic is present. If it is
+code and trailing spaces, the instLookup() looks it up in the
+instruction table through a perfect hash of the mnemonics (built at
+compile time below) to determine if the mnemonic is present. If it is
 not found, then the INV_OPCODE error results. If the mnemonic is
 found, then assemble() examines the field parseFlag for that entry.
 This flag is true if the mnemonic represents a normal instruction that
@@ -108,12 +109,12 @@ through a pointer in the flavor list for that flavor.
 // Define the "flavor lists" for each different instruction
 // The order of the "flavors" is important
 
-flavor abcdfl[] = {
+constexpr flavor abcdfl[] = {
 	{ DnDirect, DnDirect, BYTE_SIZE, twoReg, (short) 0xC100, (short) 0xC100, (short) 0 },
 	{ AnIndPre, AnIndPre, BYTE_SIZE, twoReg, (short) 0xC108, (short) 0xC108, 0 }
        };
 
-flavor addfl[] = {
+constexpr flavor addfl[] = {
 	{ All, AnDirect, WL, arithReg, (short)0 , (short)0xD0C0,(short) 0xD1C0 },             // ADDA <ea>,An
 	{ IMMEDIATE, DataAlt, BWL, immedInst, (short)0x0600, (short)0x0640, (short)0x0680 }, // ADDI or ADDQ #d,<ea>
      	{ IMMEDIATE, AnDirect, WL, quickMath, (short)0, (short)0x5040, (short)0x5080 },      // ADDQ #d,An
@@ -122,25 +123,25 @@ flavor addfl[] = {
 	{ DnDirect, MemAlt, BWL, arithAddr,(short) 0xD100,(short) 0xD140, (short)0xD180 },   // ADD Dn,<ea>
        };
 
-flavor addafl[] = {
+constexpr flavor addafl[] = {
 	{ All, AnDirect, WL, arithReg, (short)0,(short) 0xD0C0, (short)0xD1C0 },
        };
 
-flavor addifl[] = {
+constexpr flavor addifl[] = {
 	{ IMMEDIATE, DataAlt, BWL, immedInst,(short) 0x0600, (short)0x0640,(short) 0x0680 }
        };
 
-flavor addqfl[] = {
+constexpr flavor addqfl[] = {
 	{ IMMEDIATE, DataAlt, BWL, quickMath,(short) 0x5000,(short) 0x5040, (short)0x5080 },
 	{ IMMEDIATE, AnDirect, WL, quickMath,(short) 0,(short)0x5040,(short) 0x5080 }
        };
 
-flavor addxfl[] = {
+constexpr flavor addxfl[] = {
 	{ DnDirect, DnDirect, BWL, twoReg,(short) 0xD100,(short) 0xD140,(short) 0xD180 },
 	{ AnIndPre, AnIndPre, BWL, twoReg,(short) 0xD108,(short) 0xD148,(short) 0xD188 }
        };
 
-flavor andfl[] = {
+constexpr flavor andfl[] = {
 	{ Data, DnDirect, BWL, arithReg,(short) 0xC000,(short) 0xC040,(short) 0xC080 },
 	{ DnDirect, MemAlt, BWL, arithAddr,(short) 0xC100,(short) 0xC140,(short) 0xC180 },
 	{ IMMEDIATE, DataAlt, BWL, immedInst,(short) 0x0200,(short) 0x0240,(short) 0x0280 },
@@ -148,165 +149,165 @@ flavor andfl[] = {
 	{ IMMEDIATE, SRDirect, WORD_SIZE, immedWord, (short)0,(short) 0x027C,(short) 0 }
        };
 
-flavor andifl[] = {
+constexpr flavor andifl[] = {
 	{ IMMEDIATE, DataAlt, BWL, immedInst, (short)0x0200,(short) 0x0240, (short)0x0280 },
 	{ IMMEDIATE, CCRDirect, BYTE_SIZE, immedToCCR, (short)0x023C,(short) 0x023C,(short) 0 },
 	{ IMMEDIATE, SRDirect, WORD_SIZE, immedWord, (short)0,(short) 0x027C,(short) 0 }
        };
 
-flavor aslfl[] = {
+constexpr flavor aslfl[] = {
 	{ MemAlt, 0, WORD_SIZE, oneOp, (short)0,(short) 0xE1C0, (short)0 },
 	{ DnDirect, DnDirect, BWL, shiftReg, (short)0xE120,(short) 0xE160,(short) 0xE1A0 },
 	{ IMMEDIATE, DnDirect, BWL, shiftReg, (short)0xE100, (short)0xE140, (short)0xE180 }
        };
 
-flavor asrfl[] = {
+constexpr flavor asrfl[] = {
 	{ MemAlt, 0, WORD_SIZE, oneOp, (short)0, (short)0xE0C0,(short) 0 },
 	{ DnDirect, DnDirect, BWL, shiftReg, (short)0xE020, (short)0xE060, (short)0xE0A0 },
 	{ IMMEDIATE, DnDirect, BWL, shiftReg, (short)0xE000, (short)0xE040, (short)0xE080 }
        };
 
-flavor bccfl[] = {
+constexpr flavor bccfl[] = {
 	{ Absolute, 0, SHORT_SIZE | LONG_SIZE | BYTE_SIZE | WORD_SIZE, branch, 0x6400, 0x6400, 0x6400 }
        };
 
-flavor bchgfl[] = {
+constexpr flavor bchgfl[] = {
 	{ DnDirect, MemAlt, BYTE_SIZE, arithAddr, (short)0x0140, (short)0x0140, (short)0 },
 	{ DnDirect, DnDirect, LONG_SIZE, arithAddr,(short) 0,(short) 0x0140,(short) 0x0140 },
 	{ IMMEDIATE, MemAlt, BYTE_SIZE, staticBit,(short) 0x0840, (short)0x0840, (short)0 },
 	{ IMMEDIATE, DnDirect, LONG_SIZE, staticBit, (short)0, (short)0x0840, (short)0x0840 }
        };
 
-flavor bclrfl[] = {
+constexpr flavor bclrfl[] = {
 	{ DnDirect, MemAlt, BYTE_SIZE, arithAddr,(short) 0x0180, (short)0x0180, (short)0 },
 	{ DnDirect, DnDirect, LONG_SIZE, arithAddr,(short) 0, (short)0x0180,(short) 0x0180 },
 	{ IMMEDIATE, MemAlt, BYTE_SIZE, staticBit, (short)0x0880,(short) 0x0880,(short) 0 },
 	{ IMMEDIATE, DnDirect, LONG_SIZE, staticBit, (short)0,(short) 0x0880,(short) 0x0880 }
        };
 
-flavor bcsfl[] = {
+constexpr flavor bcsfl[] = {
 	{ Absolute, 0, SHORT_SIZE | LONG_SIZE | BYTE_SIZE | WORD_SIZE, branch,(short) 0x6500, (short)0x6500, (short)0x6500 }
        };
 
-flavor bfchgfl[] = {
+constexpr flavor bfchgfl[] = {
 	{ DnControlAlt, 0,  SHORT_SIZE | BWL, bitField, (short)0xEAC0, (short)0xEAC0, (short)0xEAC0 }
        };
 
-flavor bfclrfl[] = {
+constexpr flavor bfclrfl[] = {
 	{ DnControlAlt, 0,  SHORT_SIZE | BWL, bitField,(short) 0xECC0,(short) 0xECC0,(short) 0xECC0 }
        };
 
-flavor bfextsfl[] = {
+constexpr flavor bfextsfl[] = {
 	{ DnControl, DnDirect,  SHORT_SIZE | BWL, bitField,(short) 0xEBC0,(short) 0xEBC0,(short) 0xEBC0 }
        };
 
-flavor bfextufl[] = {
+constexpr flavor bfextufl[] = {
 	{ DnControl, DnDirect,  SHORT_SIZE | BWL, bitField,(short) 0xE9C0,(short) 0xE9C0,(short) 0xE9C0 }
        };
 
-flavor bfffofl[] = {
+constexpr flavor bfffofl[] = {
 	{ DnControl, DnDirect,  SHORT_SIZE | BWL, bitField,(short) 0xEDC0,(short) 0xEDC0,(short) 0xEDC0 }
        };
 
-flavor bfinsfl[] = {
+constexpr flavor bfinsfl[] = {
 	{ DnDirect, DnControlAlt,  SHORT_SIZE | BWL, bitField,(short) 0xEFC0,(short) 0xEFC0, (short)0xEFC0 }
        };
 
-flavor bfsetfl[] = {
+constexpr flavor bfsetfl[] = {
 	{ DnControlAlt, 0,  SHORT_SIZE | BWL, bitField,(short) 0xEEC0,(short) 0xEEC0,(short) 0xEEC0 }
        };
 
-flavor bftstfl[] = {
+constexpr flavor bftstfl[] = {
 	{ DnControl, 0,  SHORT_SIZE | BWL, bitField,(short) 0xE8C0,(short) 0xE8C0,(short) 0xE8C0 }
        };
 
-flavor beqfl[] = {
+constexpr flavor beqfl[] = {
 	{ Absolute, 0, SHORT_SIZE | LONG_SIZE | BYTE_SIZE | WORD_SIZE, branch, (short)0x6700,(short) 0x6700,(short) 0x6700 }
        };
 
-flavor bgefl[] = {
+constexpr flavor bgefl[] = {
 	{ Absolute, 0, SHORT_SIZE | LONG_SIZE | BYTE_SIZE | WORD_SIZE, branch, (short)0x6C00,(short) 0x6C00,(short) 0x6C00 }
        };
 
-flavor bgtfl[] = {
+constexpr flavor bgtfl[] = {
 	{ Absolute, 0, SHORT_SIZE | LONG_SIZE | BYTE_SIZE | WORD_SIZE, branch,(short) 0x6E00,(short) 0x6E00,(short) 0x6E00 }
        };
 
-flavor bhifl[] = {
+constexpr flavor bhifl[] = {
 	{ Absolute, 0, SHORT_SIZE | LONG_SIZE | BYTE_SIZE | WORD_SIZE, branch,(short) 0x6200,(short) 0x6200,(short) 0x6200 }
        };
 
-flavor bhsfl[] = {
+constexpr flavor bhsfl[] = {
 	{ Absolute, 0, SHORT_SIZE | LONG_SIZE | BYTE_SIZE | WORD_SIZE, branch,(short) 0x6400,(short) 0x6400,(short) 0x6400 }
        };
 
-flavor blefl[] = {
+constexpr flavor blefl[] = {
 	{ Absolute, 0, SHORT_SIZE | LONG_SIZE | BYTE_SIZE | WORD_SIZE, branch,(short) 0x6f00,(short) 0x6F00,(short) 0x6F00 }
        };
 
-flavor blofl[] = {
+constexpr flavor blofl[] = {
 	{ Absolute, 0, SHORT_SIZE | LONG_SIZE | BYTE_SIZE | WORD_SIZE, branch,(short) 0x6500,(short) 0x6500,(short) 0x6500 }
        };
 
-flavor blsfl[] = {
+constexpr flavor blsfl[] = {
 	{ Absolute, 0, SHORT_SIZE | LONG_SIZE | BYTE_SIZE | WORD_SIZE, branch,(short) 0x6300,(short) 0x6300,(short) 0x6300 }
        };
 
-flavor bltfl[] = {
+constexpr flavor bltfl[] = {
 	{ Absolute, 0, SHORT_SIZE | LONG_SIZE | BYTE_SIZE | WORD_SIZE, branch,(short) 0x6d00,(short) 0x6D00,(short) 0x6D00 }
        };
 
-flavor bmifl[] = {
+constexpr flavor bmifl[] = {
 	{ Absolute, 0, SHORT_SIZE | LONG_SIZE | BYTE_SIZE | WORD_SIZE, branch, (short)0x6b00,(short) 0x6B00,(short) 0x6B00 }
        };
 
-flavor bnefl[] = {
+constexpr flavor bnefl[] = {
 	{ Absolute, 0, SHORT_SIZE | LONG_SIZE | BYTE_SIZE | WORD_SIZE, branch, (short)0x6600,(short) 0x6600,(short) 0x6600 }
        };
 
-flavor bplfl[] = {
+constexpr flavor bplfl[] = {
 	{ Absolute, 0, SHORT_SIZE | LONG_SIZE | BYTE_SIZE | WORD_SIZE, branch,(short) 0x6a00,(short) 0x6A00,(short) 0x6A00 }
        };
 
-flavor brafl[] = {
+constexpr flavor brafl[] = {
 	{ Absolute, 0, SHORT_SIZE | LONG_SIZE | BYTE_SIZE | WORD_SIZE, branch,(short) 0x6000,(short) 0x6000,(short) 0x6000 }
        };
 
-flavor bsetfl[] = {
+constexpr flavor bsetfl[] = {
 	{ DnDirect, MemAlt, BYTE_SIZE, arithAddr,(short) 0x01C0,(short) 0x01C0,(short) 0 },
 	{ DnDirect, DnDirect, LONG_SIZE, arithAddr,(short) 0,(short) 0x01C0,(short) 0x01C0 },
 	{ IMMEDIATE, MemAlt, BYTE_SIZE, staticBit,(short) 0x08C0,(short) 0x08C0,(short) 0 },
 	{ IMMEDIATE, DnDirect, LONG_SIZE, staticBit,(short) 0, (short)0x08C0,(short) 0x08C0 }
        };
 
-flavor bsrfl[] = {
+constexpr flavor bsrfl[] = {
 	{ Absolute, 0, SHORT_SIZE | LONG_SIZE | BYTE_SIZE | WORD_SIZE, branch,(short) 0x6100,(short) 0x6100, (short) 0x6100 }
        };
 
-flavor btstfl[] = {
+constexpr flavor btstfl[] = {
 	{ DnDirect, Memory, BYTE_SIZE, arithAddr,(short) 0x0100,(short) 0x0100,(short) 0 },
 	{ DnDirect, DnDirect, LONG_SIZE, arithAddr,(short) 0,(short) 0x0100,(short) 0x0100 },
 	{ IMMEDIATE, Memory, BYTE_SIZE, staticBit,(short) 0x0800,(short) 0x0800,(short) 0 },
 	{ IMMEDIATE, DnDirect, LONG_SIZE, staticBit,(short) 0,(short) 0x0800,(short) 0x0800 }
        };
 
-flavor bvcfl[] = {
+constexpr flavor bvcfl[] = {
 	{ Absolute, 0, SHORT_SIZE | LONG_SIZE | BYTE_SIZE | WORD_SIZE, branch, (short)0x6800, (short)0x6800,(short) 0x6800 }
        };
 
-flavor bvsfl[] = {
+constexpr flavor bvsfl[] = {
 	{ Absolute, 0, SHORT_SIZE | LONG_SIZE | BYTE_SIZE | WORD_SIZE, branch,(short) 0x6900, (short)0x6900, (short)0x6900 }
        };
 
-flavor chkfl[] = {
+constexpr flavor chkfl[] = {
 	{ Data, DnDirect, WORD_SIZE, arithReg,(short) 0, (short)0x4180,(short) 0 }
        };
 
-flavor clrfl[] = {
+constexpr flavor clrfl[] = {
 	{ DataAlt, 0, BWL, oneOp,(short) 0x4200, (short)0x4240,(short) 0x4280 }
        };
 
-flavor cmpfl[] = {
+constexpr flavor cmpfl[] = {
 	{ Data, DnDirect, BWL, arithReg, (short)0xB000, (short)0xB040,(short) 0xB080 },
 	{ AnDirect, DnDirect, WL, arithReg,(short) 0xB000,(short) 0xB040,(short) 0xB080 },
 	{ All, AnDirect, WL, arithReg,(short) 0,(short) 0xB0C0,(short) 0xB1C0 },
@@ -314,156 +315,156 @@ flavor cmpfl[] = {
 	{ AnIndPost, AnIndPost, BWL, twoReg,(short) 0xB108,(short) 0xB148,(short) 0xB188 }
        };
 
-flavor cmpafl[] = {
+constexpr flavor cmpafl[] = {
 	{ All, AnDirect, WL, arithReg,(short) 0,(short) 0xB0C0,(short) 0xB1C0 }
        };
 
-flavor cmpifl[] = {
+constexpr flavor cmpifl[] = {
 	{ IMMEDIATE, DataAlt, BWL, immedInst,(short) 0x0C00,(short) 0x0C40,(short) 0x0C80 }
        };
 
-flavor cmpmfl[] = {
+constexpr flavor cmpmfl[] = {
 	{ AnIndPost, AnIndPost, BWL, twoReg,(short) 0xB108,(short) 0xB148,(short) 0xB188 }
        };
 
-flavor dbccfl[] = {
+constexpr flavor dbccfl[] = {
 	{ DnDirect, Absolute, WORD_SIZE, dbcc,(short) 0,(short) 0x54C8,(short) 0 }
        };
 
-flavor dbcsfl[] = {
+constexpr flavor dbcsfl[] = {
 	{ DnDirect, Absolute, WORD_SIZE, dbcc,(short) 0,(short) 0x55C8,(short) 0 }
        };
 
-flavor dbeqfl[] = {
+constexpr flavor dbeqfl[] = {
 	{ DnDirect, Absolute, WORD_SIZE, dbcc,(short) 0,(short) 0x57C8,(short) 0 }
        };
 
-flavor dbffl[] = {
+constexpr flavor dbffl[] = {
 	{ DnDirect, Absolute, WORD_SIZE, dbcc,(short) 0,(short) 0x51C8,(short) 0 }
        };
 
-flavor dbgefl[] = {
+constexpr flavor dbgefl[] = {
 	{ DnDirect, Absolute, WORD_SIZE, dbcc,(short) 0,(short) 0x5CC8,(short) 0 }
        };
 
-flavor dbgtfl[] = {
+constexpr flavor dbgtfl[] = {
 	{ DnDirect, Absolute, WORD_SIZE, dbcc,(short) 0,(short) 0x5EC8,(short) 0 }
        };
 
-flavor dbhifl[] = {
+constexpr flavor dbhifl[] = {
 	{ DnDirect, Absolute, WORD_SIZE, dbcc,(short) 0,(short) 0x52C8,(short) 0 }
        };
 
-flavor dbhsfl[] = {
+constexpr flavor dbhsfl[] = {
 	{ DnDirect, Absolute, WORD_SIZE, dbcc, (short)0,(short) 0x54C8,(short) 0 }
        };
 
-flavor dblefl[] = {
+constexpr flavor dblefl[] = {
 	{ DnDirect, Absolute, WORD_SIZE, dbcc,(short) 0, (short)0x5FC8,(short) 0 }
        };
 
-flavor dblofl[] = {
+constexpr flavor dblofl[] = {
 	{ DnDirect, Absolute, WORD_SIZE, dbcc, (short)0, (short)0x55C8,(short) 0 }
        };
 
-flavor dblsfl[] = {
+constexpr flavor dblsfl[] = {
 	{ DnDirect, Absolute, WORD_SIZE, dbcc,(short) 0,(short) 0x53C8,(short) 0 }
        };
 
-flavor dbltfl[] = {
+constexpr flavor dbltfl[] = {
 	{ DnDirect, Absolute, WORD_SIZE, dbcc, 0, (short)0x5DC8, 0 }
        };
 
-flavor dbmifl[] = {
+constexpr flavor dbmifl[] = {
 	{ DnDirect, Absolute, WORD_SIZE, dbcc, 0, (short)0x5BC8, 0 }
        };
 
-flavor dbnefl[] = {
+constexpr flavor dbnefl[] = {
 	{ DnDirect, Absolute, WORD_SIZE, dbcc, 0, (short)0x56C8, 0 }
        };
 
-flavor dbplfl[] = {
+constexpr flavor dbplfl[] = {
 	{ DnDirect, Absolute, WORD_SIZE, dbcc, 0, (short)0x5AC8, 0 }
        };
 
-flavor dbrafl[] = {
+constexpr flavor dbrafl[] = {
 	{ DnDirect, Absolute, WORD_SIZE, dbcc, 0, (short)0x51C8, 0 }
        };
 
-flavor dbtfl[] = {
+constexpr flavor dbtfl[] = {
 	{ DnDirect, Absolute, WORD_SIZE, dbcc, 0, (short)0x50C8, 0 }
        };
 
-flavor dbvcfl[] = {
+constexpr flavor dbvcfl[] = {
 	{ DnDirect, Absolute, WORD_SIZE, dbcc, 0, (short)0x58C8, 0 }
        };
 
-flavor dbvsfl[] = {
+constexpr flavor dbvsfl[] = {
 	{ DnDirect, Absolute, WORD_SIZE, dbcc, 0, (short)0x59C8, 0 }
        };
 
-flavor divsfl[] = {
+constexpr flavor divsfl[] = {
 	{ Data, DnDirect, WORD_SIZE, arithReg, 0, (short)0x81C0, 0 }
        };
 
-flavor divufl[] = {
+constexpr flavor divufl[] = {
 	{ Data, DnDirect, WORD_SIZE, arithReg, 0, (short)0x80C0, 0 }
        };
 
-flavor eorfl[] = {
+constexpr flavor eorfl[] = {
 	{ DnDirect, DataAlt, BWL, arithAddr, (short)0xB100, (short)0xB140, (short)0xB180 },
 	{ IMMEDIATE, DataAlt, BWL, immedInst, (short)0x0A00, (short)0x0A40, (short)0x0A80 }
        };
 
-flavor eorifl[] = {
+constexpr flavor eorifl[] = {
 	{ IMMEDIATE, DataAlt, BWL, immedInst, (short)0x0A00, (short)0x0A40, (short)0x0A80 },
 	{ IMMEDIATE, CCRDirect, BYTE_SIZE, immedToCCR, (short)0x0A3C, (short)0x0A3C, 0 },
 	{ IMMEDIATE, SRDirect, WORD_SIZE, immedWord, 0, (short)0x0A7C, 0 }
        };
 
-flavor exgfl[] = {
+constexpr flavor exgfl[] = {
 	{ DnDirect, DnDirect, LONG_SIZE, exg, 0, (short)0xC140, (short)0xC140 },
 	{ AnDirect, AnDirect, LONG_SIZE, exg, 0, (short)0xC148, (short)0xC148 },
 	{ GenReg, GenReg, LONG_SIZE, exg, 0, (short)0xC188, (short)0xC188 }
        };
 
-flavor extfl[] = {
+constexpr flavor extfl[] = {
 	{ DnDirect, 0, WL, oneReg, 0, (short)0x4880, (short)0x48C0 }
        };
 
-flavor illegalfl[] = {
+constexpr flavor illegalfl[] = {
 	{ 0, 0, 0, zeroOp, 0, (short)0x4AFC, 0 }
        };
 
-flavor jmpfl[] = {
+constexpr flavor jmpfl[] = {
 	{ Control, 0, 0, oneOp, 0, (short)0x4EC0, 0 }
        };
 
-flavor jsrfl[] = {
+constexpr flavor jsrfl[] = {
 	{ Control, 0, 0, oneOp, 0, (short)0x4E80, 0 }
        };
 
-flavor leafl[] = {
+constexpr flavor leafl[] = {
 	{ Control, AnDirect, LONG_SIZE, arithReg, 0, (short)0x41C0, (short)0x41C0 }
        };
 
-flavor linkfl[] = {
+constexpr flavor linkfl[] = {
 	{ AnDirect, IMMEDIATE, 0, link, 0, (short)0x4E50, 0 }
        };
 
-flavor lslfl[] = {
+constexpr flavor lslfl[] = {
 	{ MemAlt, 0, WORD_SIZE, oneOp, 0, (short)0xE3C0, 0 },
 	{ DnDirect, DnDirect, BWL, shiftReg, (short)0xE128, (short)0xE168, (short)0xE1A8 },
 	{ IMMEDIATE, DnDirect, BWL, shiftReg, (short)0xE108, (short)0xE148, (short)0xE188 }
        };
 
-flavor lsrfl[] = {
+constexpr flavor lsrfl[] = {
 	{ MemAlt, 0, WORD_SIZE, oneOp, 0, (short)0xE2C0, 0 },
 	{ DnDirect, DnDirect, BWL, shiftReg, (short)0xE028, (short)0xE068, (short)0xE0A8 },
 	{ IMMEDIATE, DnDirect, BWL, shiftReg, (short)0xE008, (short)0xE048, (short)0xE088 }
        };
 
-flavor movefl[] = {
+constexpr flavor movefl[] = {
 	{ Data, DataAlt, BWL, move, (short)0x1000, (short)0x3000, (short)0x2000 },
 	{ AnDirect, DataAlt, WL, move, (short)0x1000, (short)0x3000, (short)0x2000 },
 	{ All, AnDirect, WL, move, 0, (short)0x3000, (short)0x2000 },
@@ -475,7 +476,7 @@ flavor movefl[] = {
 	{ USPDirect, AnDirect, LONG_SIZE, moveUSP, 0, (short)0x4E68, (short)0x4E68 }
        };
 
-flavor moveafl[] = {
+constexpr flavor moveafl[] = {
 	{ All, AnDirect, WL, move, 0, (short)0x3000, (short)0x2000 }
        };
 
@@ -486,14 +487,14 @@ flavor moveafl[] = {
 //           LONG_SIZE, movec, 0, (short)0x4E7B, (short)0x4E7B }
 //       };
 
-flavor movepfl[] = {
+constexpr flavor movepfl[] = {
 	{ DnDirect, AnIndDisp, WL, movep, 0, (short)0x0188, (short)0x01C8 },
 	{ AnIndDisp, DnDirect, WL, movep, 0, (short)0x0108, (short)0x0148 },
 	{ DnDirect, AnInd, WL, movep, 0, (short)0x0188, (short)0x01C8 },
 	{ AnInd, DnDirect, WL, movep, 0, (short)0x0108, (short)0x0148 }
        };
 
-flavor moveqfl[] = {
+constexpr flavor moveqfl[] = {
 	{ IMMEDIATE, DnDirect, LONG_SIZE, moveq, 0, (short)0x7000, (short)0x7000 }
        };
 
@@ -502,35 +503,35 @@ flavor moveqfl[] = {
 //	{ MemAlt, GenReg, BWL, moves, (short)0x0E00, (short)0x0E40, (short)0x0E80 }
 //       };
 
-flavor mulsfl[] = {
+constexpr flavor mulsfl[] = {
 	{ Data, DnDirect, WORD_SIZE, arithReg, 0, (short)0xC1C0, 0 }
        };
 
-flavor mulufl[] = {
+constexpr flavor mulufl[] = {
 	{ Data, DnDirect, WORD_SIZE, arithReg, 0, (short)0xC0C0, 0 }
        };
 
-flavor nbcdfl[] = {
+constexpr flavor nbcdfl[] = {
 	{ DataAlt, 0, BYTE_SIZE, oneOp, (short)0x4800, (short)0x4800, 0 }
        };
 
-flavor negfl[] = {
+constexpr flavor negfl[] = {
 	{ DataAlt, 0, BWL, oneOp, (short)0x4400, (short)0x4440, (short)0x4480 }
        };
 
-flavor negxfl[] = {
+constexpr flavor negxfl[] = {
 	{ DataAlt, 0, BWL, oneOp, (short)0x4000, (short)0x4040, (short)0x4080 }
        };
 
-flavor nopfl[] = {
+constexpr flavor nopfl[] = {
 	{ 0, 0, 0, zeroOp, 0, (short)0x4E71, 0 }
        };
 
-flavor notfl[] = {
+constexpr flavor notfl[] = {
 	{ DataAlt, 0, BWL, oneOp, (short)0x4600, (short)0x4640, (short)0x4680 }
        };
 
-flavor orfl[] = {
+constexpr flavor orfl[] = {
 	{ Data, DnDirect, BWL, arithReg, (short)0x8000, (short)0x8040, (short)0x8080 },
 	{ DnDirect, MemAlt, BWL, arithAddr, (short)0x8100, (short)0x8140, (short)0x8180 },
 	{ IMMEDIATE, DataAlt, BWL, immedInst, (short)0x0000, (short)0x0040, (short)0x0080 },
@@ -538,39 +539,39 @@ flavor orfl[] = {
 	{ IMMEDIATE, SRDirect, WORD_SIZE, immedWord, 0, (short)0x007C, 0 }
        };
 
-flavor orifl[] = {
+constexpr flavor orifl[] = {
 	{ IMMEDIATE, DataAlt, BWL, immedInst, (short)0x0000, (short)0x0040, (short)0x0080 },
 	{ IMMEDIATE, CCRDirect, BYTE_SIZE, immedToCCR, (short)0x003C, (short)0x003C, 0 },
 	{ IMMEDIATE, SRDirect, WORD_SIZE, immedWord, 0, (short)0x007C, 0 }
        };
 
-flavor peafl[] = {
+constexpr flavor peafl[] = {
 	{ Control, 0, LONG_SIZE, oneOp, 0, (short)0x4840, (short)0x4840 }
        };
 
-flavor resetfl[] = {
+constexpr flavor resetfl[] = {
 	{ 0, 0, 0, zeroOp, 0, (short)0x4E70, 0 }
        };
 
-flavor rolfl[] = {
+constexpr flavor rolfl[] = {
 	{ MemAlt, 0, WORD_SIZE, oneOp, 0, (short)0xE7C0, 0 },
 	{ DnDirect, DnDirect, BWL, shiftReg, (short)0xE138, (short)0xE178, (short)0xE1B8 },
 	{ IMMEDIATE, DnDirect, BWL, shiftReg, (short)0xE118, (short)0xE158, (short)0xE198 }
        };
 
-flavor rorfl[] = {
+constexpr flavor rorfl[] = {
 	{ MemAlt, 0, WORD_SIZE, oneOp, 0, (short)0xE6C0, 0 },
 	{ DnDirect, DnDirect, BWL, shiftReg, (short)0xE038, (short)0xE078, (short)0xE0B8 },
 	{ IMMEDIATE, DnDirect, BWL, shiftReg, (short)0xE018, (short)0xE058, (short)0xE098 }
        };
 
-flavor roxlfl[] = {
+constexpr flavor roxlfl[] = {
 	{ MemAlt, 0, WORD_SIZE, oneOp, 0, (short)0xE5C0, 0 },
 	{ DnDirect, DnDirect, BWL, shiftReg, (short)0xE130, (short)0xE170, (short)0xE1B0 },
 	{ IMMEDIATE, DnDirect, BWL, shiftReg, (short)0xE110, (short)0xE150, (short)0xE190 }
        };
 
-flavor roxrfl[] = {
+constexpr flavor roxrfl[] = {
 	{ MemAlt, 0, WORD_SIZE, oneOp, 0, (short)0xE4C0, 0 },
 	{ DnDirect, DnDirect, BWL, shiftReg, (short)0xE030, (short)0xE070, (short)0xE0B0 },
 	{ IMMEDIATE, DnDirect, BWL, shiftReg, (short)0xE010, (short)0xE050, (short)0xE090 }
@@ -580,92 +581,92 @@ flavor roxrfl[] = {
 //	{ IMMEDIATE, 0, 0, immedWord, 0, (short)0x4E74, 0 }
 //       };
 
-flavor rtefl[] = {
+constexpr flavor rtefl[] = {
 	{ 0, 0, 0, zeroOp, 0, (short)0x4E73, 0 }
        };
 
-flavor rtrfl[] = {
+constexpr flavor rtrfl[] = {
 	{ 0, 0, 0, zeroOp, 0, (short)0x4E77, 0 }
        };
 
-flavor rtsfl[] = {
+constexpr flavor rtsfl[] = {
 	{ 0, 0, 0, zeroOp, 0, (short)0x4E75, 0 }
        };
 
-flavor sbcdfl[] = {
+constexpr flavor sbcdfl[] = {
 	{ DnDirect, DnDirect, BYTE_SIZE, twoReg, (short)0x8100, (short)0x8100, 0 },
 	{ AnIndPre, AnIndPre, BYTE_SIZE, twoReg, (short)0x8108, (short)0x8108, 0 }
        };
 
-flavor sccfl[] = {
+constexpr flavor sccfl[] = {
 	{ DataAlt, 0, BYTE_SIZE, scc, (short)0x54C0, (short)0x54C0, 0 }
        };
 
-flavor scsfl[] = {
+constexpr flavor scsfl[] = {
 	{ DataAlt, 0, BYTE_SIZE, scc, (short)0x55C0, (short)0x55C0, 0 }
        };
 
-flavor seqfl[] = {
+constexpr flavor seqfl[] = {
 	{ DataAlt, 0, BYTE_SIZE, scc, (short)0x57C0, (short)0x57C0, 0 }
        };
 
-flavor sffl[] = {
+constexpr flavor sffl[] = {
 	{ DataAlt, 0, BYTE_SIZE, scc, (short)0x51C0, (short)0x51C0, 0 }
        };
 
-flavor sgefl[] = {
+constexpr flavor sgefl[] = {
 	{ DataAlt, 0, BYTE_SIZE, scc, (short)0x5CC0, (short)0x5CC0, 0 }
        };
 
-flavor sgtfl[] = {
+constexpr flavor sgtfl[] = {
 	{ DataAlt, 0, BYTE_SIZE, scc, (short)0x5EC0, (short)0x5EC0, 0 }
        };
 
-flavor shifl[] = {
+constexpr flavor shifl[] = {
 	{ DataAlt, 0, BYTE_SIZE, scc, (short)0x52C0, (short)0x52C0, 0 }
        };
 
-flavor shsfl[] = {
+constexpr flavor shsfl[] = {
 	{ DataAlt, 0, BYTE_SIZE, scc, (short)0x54C0, (short)0x54C0, 0 }
        };
 
-flavor slefl[] = {
+constexpr flavor slefl[] = {
 	{ DataAlt, 0, BYTE_SIZE, scc, (short)0x5FC0, (short)0x5FC0, 0 }
        };
 
-flavor slofl[] = {
+constexpr flavor slofl[] = {
 	{ DataAlt, 0, BYTE_SIZE, scc, (short)0x55C0, (short)0x55C0, 0 }
        };
 
-flavor slsfl[] = {
+constexpr flavor slsfl[] = {
 	{ DataAlt, 0, BYTE_SIZE, scc, (short)0x53C0, (short)0x53C0, 0 }
        };
 
-flavor sltfl[] = {
+constexpr flavor sltfl[] = {
 	{ DataAlt, 0, BYTE_SIZE, scc, (short)0x5DC0, (short)0x5DC0, 0 }
        };
 
-flavor smifl[] = {
+constexpr flavor smifl[] = {
 	{ DataAlt, 0, BYTE_SIZE, scc, (short)0x5BC0, (short)0x5BC0, 0 }
        };
 
-flavor snefl[] = {
+constexpr flavor snefl[] = {
 	{ DataAlt, 0, BYTE_SIZE, scc, (short)0x56C0, (short)0x56C0, 0 }
        };
 
-flavor splfl[] = {
+constexpr flavor splfl[] = {
 	{ DataAlt, 0, BYTE_SIZE, scc, (short)0x5AC0, (short)0x5AC0, 0 }
        };
 
-flavor stfl[] = {
+constexpr flavor stfl[] = {
 	{ DataAlt, 0, BYTE_SIZE, scc, (short)0x50C0, (short)0x50C0, 0 }
        };
 
-flavor stopfl[] = {
+constexpr flavor stopfl[] = {
 	{ IMMEDIATE, 0, 0, immedWord, 0, (short)0x4E72, 0 }
        };
 
-flavor subfl[] = {
+constexpr flavor subfl[] = {
 	{ All, AnDirect, WL, arithReg, 0, (short)0x90C0, (short)0x91C0 },                // changed order to match addfl CK 5/22/07
 	{ IMMEDIATE, DataAlt, BWL, immedInst, (short)0x0400, (short)0x0440, (short)0x0480 },
 	{ IMMEDIATE, AnDirect, WL, quickMath, 0, (short)0x5140, (short)0x5180 },
@@ -674,53 +675,53 @@ flavor subfl[] = {
 	{ DnDirect, MemAlt, BWL, arithAddr, (short)0x9100, (short)0x9140, (short)0x9180 },
        };
 
-flavor subafl[] = {
+constexpr flavor subafl[] = {
 	{ All, AnDirect, WL, arithReg, 0, (short)0x90C0, (short)0x91C0 }
        };
 
-flavor subifl[] = {
+constexpr flavor subifl[] = {
 	{ IMMEDIATE, DataAlt, BWL, immedInst, (short)0x0400, (short)0x0440, (short)0x0480 }
        };
 
-flavor subqfl[] = {
+constexpr flavor subqfl[] = {
 	{ IMMEDIATE, DataAlt, BWL, quickMath, (short)0x5100, (short)0x5140, (short)0x5180 },
 	{ IMMEDIATE, AnDirect, WL, quickMath, 0, (short)0x5140, (short)0x5180 }
        };
 
-flavor subxfl[] = {
+constexpr flavor subxfl[] = {
 	{ DnDirect, DnDirect, BWL, twoReg, (short)0x9100, (short)0x9140, (short)0x9180 },
 	{ AnIndPre, AnIndPre, BWL, twoReg, (short)0x9108, (short)0x9148, (short)0x9188 }
        };
 
-flavor svcfl[] = {
+constexpr flavor svcfl[] = {
 	{ DataAlt, 0, BYTE_SIZE, scc, (short)0x58C0, (short)0x58C0, 0 }
        };
 
-flavor svsfl[] = {
+constexpr flavor svsfl[] = {
 	{ DataAlt, 0, BYTE_SIZE, scc, (short)0x59C0, (short)0x59C0, 0 }
        };
 
-flavor swapfl[] = {
+constexpr flavor swapfl[] = {
 	{ DnDirect, 0, WORD_SIZE, oneReg, 0, (short)0x4840, 0 }
        };
 
-flavor tasfl[] = {
+constexpr flavor tasfl[] = {
 	{ DataAlt, 0, BYTE_SIZE, oneOp, (short)0x4AC0, (short)0x4AC0, 0 }
        };
 
-flavor trapfl[] = {
+constexpr flavor trapfl[] = {
 	{ IMMEDIATE, 0, 0, trap, 0, (short)0x4E40, 0 }
        };
 
-flavor trapvfl[] = {
+constexpr flavor trapvfl[] = {
 	{ 0, 0, 0, zeroOp, 0, (short)0x4E76, 0 }
        };
 
-flavor tstfl[] = {
+constexpr flavor tstfl[] = {
 	{ DataAlt, 0, BWL, oneOp, (short)0x4A00, (short)0x4A40, (short)0x4A80 }
        };
 
-flavor unlkfl[] = {
+constexpr flavor unlkfl[] = {
 	{ AnDirect, 0, 0, oneReg, 0, (short)0x4E58, 0 }
        };
 
@@ -731,9 +732,10 @@ flavor unlkfl[] = {
 
 
 /* The instruction table itself... */
-// Instructions MUST BE IN ALPHABETICAL ORDER
+// Instructions are kept in alphabetical order for readability; lookup is
+// done through the perfect hash built below so the order does not matter.
 
-instruction instTable[] = {
+extern constexpr instruction instTable[] = {
 	{ "ABCD", abcdfl, flavorCount(abcdfl), true, NULL },
 	{ "ADD", addfl, flavorCount(addfl), true, NULL },
 	{ "ADDA", addafl, flavorCount(addafl), true, NULL },
@@ -821,6 +823,8 @@ instruction instTable[] = {
 	{ "ILLEGAL", illegalfl, flavorCount(illegalfl), true, NULL },
         { "INCBIN", NULL, 0, false, incbin },
         { "INCLUDE", NULL, 0, false, include },
+        { "IRP", NULL, 0, false, irp },
+        { "IRPC", NULL, 0, false, irpc },
 	{ "JMP", jmpfl, flavorCount(jmpfl), true, NULL },
 	{ "JSR", jsrfl, flavorCount(jsrfl), true, NULL },
 	{ "LEA", leafl, flavorCount(leafl), true, NULL },
@@ -854,6 +858,7 @@ instruction instTable[] = {
 	{ "PEA", peafl, flavorCount(peafl), true, NULL },
 	{ "REG", NULL, 0, false, reg },
         { "REPEAT", NULL, 0, false, asmStructure },
+        { "REPT", NULL, 0, false, rept },
 	{ "RESET", resetfl, flavorCount(resetfl), true, NULL },
 	{ "ROL", rolfl, flavorCount(rolfl), true, NULL },
 	{ "ROR", rorfl, flavorCount(rorfl), true, NULL },
@@ -905,5 +910,257 @@ instruction instTable[] = {
 
 /* Declare a global variable containing the size of the instruction table */
 
-int tableSize = sizeof(instTable)/sizeof(instruction);
+constexpr int tableSize = sizeof(instTable)/sizeof(instruction);
 
+
+//---------------------------------------------------------
+// Perfect hash of the mnemonics, built at compile time.
+// A mnemonic's FNV-1a hash selects one of INSTBUCKETS buckets. Each bucket
+// has a seed, found by the builder, which mixed with the hash places every
+// mnemonic of the bucket in its own slot of the slot table. A lookup is
+// then one hash of the opcode and one compare against a single entry.
+
+const int INSTBUCKETS = 64;             // number of buckets (power of two)
+const int INSTSLOTS = 512;              // number of slots (power of two)
+
+struct instHash {
+  short slot[INSTSLOTS];                // index in instTable, -1 if empty
+  unsigned char seed[INSTBUCKETS];      // seed of each bucket
+  bool unique;                          // false if a mnemonic is duplicated
+  bool ok;                              // false if no seed could be found
+};
+
+// Return the slot of hash value h using seed
+constexpr int instSlot(unsigned int h, unsigned int seed)
+{
+  h ^= seed * 0x9E3779B9u;
+  h ^= h >> 16;
+  h *= 0x85EBCA6Bu;
+  h ^= h >> 13;
+  h *= 0xC2B2AE35u;
+  h ^= h >> 16;
+  return h & (INSTSLOTS - 1);
+}
+
+constexpr unsigned int instNameHash(const char *name)
+{
+  unsigned int h = FNV_BASIS;
+  while (*name) {
+    h ^= (unsigned char) *name++;
+    h *= FNV_PRIME;
+  }
+  return h;
+}
+
+constexpr bool instSameName(const char *a, const char *b)
+{
+  while (*a && *a == *b) {
+    a++;
+    b++;
+  }
+  return *a == *b;
+}
+
+// Build the slot table, placing the largest buckets first
+constexpr instHash buildInstHash()
+{
+  instHash t = {};
+  int bucketSize[INSTBUCKETS] = {};
+  int i = 0, j = 0, b = 0, size = 0, seed = 0, maxSize = 0;
+  bool placed = false;
+
+  for (i=0; i<INSTSLOTS; i++)
+    t.slot[i] = -1;
+  t.unique = true;
+  t.ok = true;
+  for (i=0; i<tableSize; i++)
+    for (j=i+1; j<tableSize; j++)
+      if (instSameName(instTable[i].mnemonic, instTable[j].mnemonic))
+        t.unique = false;
+  if (!t.unique)
+    return t;
+
+  for (i=0; i<tableSize; i++) {
+    b = instNameHash(instTable[i].mnemonic) & (INSTBUCKETS - 1);
+    if (++bucketSize[b] > maxSize)
+      maxSize = bucketSize[b];
+  }
+
+  for (size=maxSize; size>0; size--) {
+    for (b=0; b<INSTBUCKETS; b++) {
+      if (bucketSize[b] != size)
+        continue;
+      placed = false;
+      for (seed=0; seed<256 && !placed; seed++) {
+        placed = true;
+        for (i=0; i<tableSize; i++) {     // try to place every mnemonic of bucket
+          unsigned int h = instNameHash(instTable[i].mnemonic);
+          if ((int) (h & (INSTBUCKETS - 1)) != b)
+            continue;
+          int s = instSlot(h, seed);
+          if (t.slot[s] != -1) {          // slot taken, undo this seed
+            for (j=0; j<INSTSLOTS; j++)
+              if (t.slot[j] >= 0 &&
+                  (int) (instNameHash(instTable[t.slot[j]].mnemonic) & (INSTBUCKETS - 1)) == b)
+                t.slot[j] = -1;
+            placed = false;
+            break;
+          }
+          t.slot[s] = i;
+        }
+        if (placed)
+          t.seed[b] = seed;
+      }
+      if (!placed)
+        t.ok = false;
+    }
+  }
+
+  // every mnemonic must resolve to its own entry
+  for (i=0; i<tableSize; i++) {
+    unsigned int h = instNameHash(instTable[i].mnemonic);
+    if (t.slot[instSlot(h, t.seed[h & (INSTBUCKETS - 1)])] != i)
+      t.ok = false;
+  }
+  return t;
+}
+
+constexpr instHash instHashTable = buildInstHash();
+
+static_assert(instHashTable.unique, "duplicate mnemonic in instTable");
+static_assert(instHashTable.ok, "no perfect hash for instTable, change INSTBUCKETS or INSTSLOTS");
+
+
+//---------------------------------------------------------
+// Return the instTable entry for the first len characters of name or
+// NULL if name is not a mnemonic. h is the FNV-1a hash of those characters.
+const instruction *instFind(const char *name, int len, unsigned int h)
+{
+  int i = instHashTable.slot[instSlot(h, instHashTable.seed[h & (INSTBUCKETS - 1)])];
+  const char *m;
+
+  if (i < 0)
+    return NULL;
+  m = instTable[i].mnemonic;
+  if (strncmp(m, name, len) || m[len])
+    return NULL;
+  return &instTable[i];
+}
+
+
+
+//---------------------------------------------------------
+// Addressing mode dispatch tables, built at compile time.
+// For each instruction the tables give the flavor that the flavor list
+// walk in createCode() used to find:
+//   - the first flavor without operands, or
+//   - before the first flavor with a destination, the first flavor whose
+//     source modes include the source, or
+//   - after the destination is parsed, the first flavor whose source and
+//     (if any) destination modes include the operands.
+// The skeleton mask of every flavor is also stored by size code so no
+// further tests are needed to encode the instruction.
+
+struct dispatchTables {
+  instDispatch d[tableSize];
+  bool ok;                              // false if a flavor list is unsupported
+};
+
+// Return the skeleton mask of flavor f for size code size.
+// *bad is set if the size code is not valid for the flavor.
+constexpr unsigned short flavorMask(const flavor &f, int size, bool *bad)
+{
+  *bad = false;
+  if (!size || size & f.sizes) {
+    if (size & (BYTE_SIZE | SHORT_SIZE))
+      return f.bytemask;
+    else if (!size || size == WORD_SIZE)
+      return f.wordmask;
+    return f.longmask;
+  }
+  *bad = true;
+  return f.wordmask;
+}
+
+constexpr bool flavorMatch(const flavor &f, int source, int dest)
+{
+  return !f.source || ((source & f.source) && (!f.dest || (dest & f.dest)));
+}
+
+constexpr dispatchTables buildDispatch()
+{
+  dispatchTables t = {};
+  int i = 0, n = 0, f = 0, D = 0, s = 0, d = 0, size = 0;
+  bool bad = false;
+
+  t.ok = true;
+  for (i=0; i<tableSize; i++) {
+    instDispatch &x = t.d[i];
+    const flavor *fl = instTable[i].flavorPtr;
+    n = instTable[i].flavorCount;
+
+    for (s=0; s<=NMODES; s++) {
+      x.noDest[s] = NOFLAVOR;
+      for (d=0; d<=NMODES; d++)
+        x.withDest[s][d] = NOFLAVOR;
+    }
+    x.destFlavor = NOFLAVOR;
+    if (!n)                             // directive
+      continue;
+    if (n > MAXFLAVORS) {
+      t.ok = false;
+      continue;
+    }
+    for (f=0; f<n; f++)
+      if (!fl[f].source && fl[f].dest)  // destination without source
+        t.ok = false;
+
+    x.zeroOp = !fl[0].source;
+    x.srcField = (fl[0].exec == bitField);
+    for (D=0; D<n && !fl[D].dest; D++)
+      ;
+    if (D < n) {
+      x.destFlavor = D;
+      x.destField = (fl[D].exec == bitField && fl[D].source == DnDirect);
+    }
+
+    for (s=0; s<=NMODES; s++) {
+      int smode = (s < NMODES) ? 1 << s : 0;
+      for (f=0; f<D; f++)
+        if (flavorMatch(fl[f], smode, 0)) {
+          x.noDest[s] = f;
+          break;
+        }
+      for (d=0; d<=NMODES; d++) {
+        int dmode = (d < NMODES) ? 1 << d : 0;
+        for (f=D; f<n; f++)
+          if (flavorMatch(fl[f], smode, dmode)) {
+            x.withDest[s][d] = f;
+            break;
+          }
+      }
+    }
+
+    for (f=0; f<n; f++) {
+      x.badSize[f] = 0;
+      for (size=0; size<=SHORT_SIZE; size++) {
+        x.mask[f][size] = flavorMask(fl[f], size, &bad);
+        if (bad)
+          x.badSize[f] |= 1 << size;
+      }
+    }
+  }
+  return t;
+}
+
+constexpr dispatchTables instDispatchTables = buildDispatch();
+
+static_assert(instDispatchTables.ok, "flavor list not supported by the dispatch tables");
+
+
+//---------------------------------------------------------
+// Return the dispatch table of an instruction from instTable
+const instDispatch *instDispatchFor(const instruction *inst)
+{
+  return &instDispatchTables.d[inst - instTable];
+}
@@ -34,6 +34,25 @@
  *		be printed to indicate the omission of values from the
  *		listing, and the data will not be added to the file. 
  *
+ *		listFill()
+ *		Prints a block of copies of the same data as listObj()
+ *		would, stopping once the rest would be omitted.
+ *
+ *		finishList()
+ *		Writes the listing to the listing file. The listing is
+ *		built in memory, so the starting address is filled in
+ *		on its first line before the file is written, which may
+ *		then be a pipe.
+ *
+ *		listPos(), listPatch(), listCut()
+ *		Give the position in the listing, fill in text written
+ *		earlier and cut the listing off, for one pass assembly.
+ *
+ *		The -n option creates no listing. The listing routines
+ *		then only count the lines, for the line numbers of the
+ *		error messages, which finishList() prints on the
+ *		console.
+ *
  *	 Usage: initList(name)
  *		char *name;
  *
@@ -44,6 +63,21 @@
  *		listObj(data, size)
  *		int data, size;
  *
+ *		listFill(data, size, count)
+ *		int data, size, count;
+ *
+ *		finishList()
+ *
+ *		listPos()
+ *
+ *		listPatch(pos, text, count)
+ *		long pos;
+ *		const char *text;
+ *		int count;
+ *
+ *		listCut(pos)
+ *		long pos;
+ *
  *      Author: Paul McKee
  *		ECE492    North Carolina State University
  *
@@ -60,6 +94,8 @@
 
 #include <stdio.h>
 #include <ctype.h>
+#include <string.h>
+#include <string>
 
 #include "asm.h"
 #include "proto.h"
@@ -68,7 +104,7 @@
 extern int	loc;
 extern bool pass2, CEXflag, continuation;
 extern bool CREflag, offsetMode, showEqual;
-extern char line[256];
+extern char *line;
 extern FILE *listFile;
 extern int lineNum;
 extern int lineNumL68;
@@ -87,12 +123,50 @@ extern unsigned int startAddress;     // starting address of program
 
 extern tabTypes tabType;
 extern bool listFlag;
+extern bool onePass;            // true while assembling in one pass
 bool createdL68;                // true when L68 (listing) file is created
+bool noList = false;            // true if no listing is wanted (-n)
+int listObjAt;                  // offset in listData of last listObj() data
+
+static std::string listBuf;     // the listing, written by finishList()
+static const char hexDigit[] = "0123456789ABCDEF";
+const int LISTBUFSIZE = 65536;  // listing space reserved at the start
+
+//------------------------------------------------------------
+// Write data as digits hex digits at p, without a terminator. Returns
+// the end of the digits.
+static char *listHex(char *p, unsigned int data, int digits)
+{
+  for (int i=digits-1; i>=0; i--, data >>= 4)
+    p[i] = hexDigit[data & 0xF];
+  return p + digits;
+}
+
+//------------------------------------------------------------
+// Add n to the listing as "%6d" would
+static void listNumber(int n)
+{
+  char digits[12], *p = digits + sizeof(digits);
+  unsigned int u = n;
+  int length;
+
+  do {
+    *--p = '0' + u % 10;
+    u /= 10;
+  } while (u);
+  length = digits + sizeof(digits) - p;
+  if (length < 6)
+    listBuf.append(6 - length, ' ');
+  listBuf.append(p, length);
+}
 
 int initList(char *name)
 {
   try {
     createdL68 = false;
+    listBuf.clear();
+    if (noList)
+      return NORMAL;
     listFile = fopen(name, "w");
     if (!listFile) {
       sprintf(buffer,"Unable to create listing file");
@@ -101,7 +175,7 @@ int initList(char *name)
 
     //  TDateTime DateTime = Time();  // store the current date and time
    
-
+    listBuf.reserve(LISTBUFSIZE);
     createdL68 = true;
     return NORMAL;
   }
@@ -119,11 +193,15 @@ int initList(char *name)
 
 int listLoc()
 {
-  if (offsetMode || showEqual)
-    sprintf(listData, "%08lX= ", loc);
-  else
-    sprintf(listData, "%08lX  ", loc);
   listPtr = listData + 10;
+  if (!createdL68)
+    return NORMAL;
+  listHex(listData, loc, 8);
+  listData[8] = (offsetMode || showEqual) ? '=' : ' ';
+  listData[9] = ' ';
+  listData[10] = '\0';
+  if (onePass)
+    fixListCut(0);              // fields of an unlisted line are dropped
 
   return NORMAL;
 }
@@ -132,6 +210,8 @@ int listLoc()
 // when skipCond is True the conditional test was False
 int listCond(bool cond)
 {
+  if (!createdL68)
+    return NORMAL;
   if (cond)
     sprintf(listPtr,"               %s ","FALSE");
   else
@@ -142,15 +222,31 @@ int listCond(bool cond)
 
 int listLine(char *text, const char *lineIdent)   // ck 4-2006 lineIdent[]
 {
+  int length;
+
   // FixedTabSize->Value
   try {
-    if (!createdL68)
+    if (!createdL68) {
+      lineNumL68++;             // error messages show the line number
       return NORMAL;
-    fprintf(listFile, "%-32.32s", listData);
+    }
+    if (onePass)
+      fixListed(32);            // fields shown in the 32 columns
+    for (length=0; length<32 && listData[length]; length++)
+      ;
+    listBuf.append(listData, length);
+    listBuf.append(32 - length, ' ');
     if (!continuation) {
+      listNumber(lineNumL68);
+      if (lineIdent[0]) {               // if line identifier
+        listBuf += lineIdent;
+        listBuf += ' ';
+      } else
+        listBuf.append("  ");
+
       // replace tab with spaces
-      int i=0, j=0, k, t;
-      while (text[i] && j < 255-8) {
+      int i=0, j=0, t;
+      while (text[i]) {
 	if (text[i] == '\t') {   
            /*
           if (Active->Project.TabType == Assembly) {
@@ -164,27 +260,19 @@ int listLine(char *text, const char *lineIdent)   // ck 4-2006 lineIdent[]
             t = 4 - (j % 4);
 
           //}
-          for (k=0; k<t; k++)       // replace with spaces
-	    buffer[j++] = ' ';
-        } else
-          buffer[j++] = text[i];        // else, copy character
+          listBuf.append(t, ' ');       // replace with spaces
+          j += t;
+        } else {
+          listBuf += text[i];           // else, copy character
+          j++;
+        }
         i++;
       }
-      if (j>0 && buffer[j-1] != '\n')   // if line does not end in '\n'
-        buffer[j++] = '\n';             // add it
-      buffer[j] = '\0';
-
-      if (lineIdent[0])                 // if line identifier
-        fprintf(listFile, "%6d%s %s", lineNumL68, lineIdent, buffer);
-      else
-        fprintf(listFile, "%6d  %s", lineNumL68, buffer);
+      if (j>0 && listBuf[listBuf.size()-1] != '\n') // if line does not end in '\n'
+        listBuf += '\n';               // add it
     } else
-      putc('\n', listFile);
+      listBuf += '\n';
 
-    if (ferror(listFile)) {
-      sprintf(buffer,"Error writing to listing file\n");
-      return MILD_ERROR;
-    }
     lineNumL68++;
   }
   catch( ... ) {
@@ -199,12 +287,13 @@ int listLine(char *text, const char *lineIdent)   // ck 4-2006 lineIdent[]
 // List error message
 // Errors are always written to file if possible
 // They are not turned off by NOLIST directive
+// Without a listing (-n) they are kept for the console
 int listError(char *lineNum, char *errMsg)
 {
-  if (!createdL68)
+  if (!createdL68 && !noList)
     return NORMAL;
-  fprintf(listFile, lineNum);         // write line number to file
-  fprintf(listFile, errMsg);          // write error message to file
+  listBuf += lineNum;           // line number
+  listBuf += errMsg;            // error message
   return NORMAL;
 }
 
@@ -213,14 +302,19 @@ int listText(const char *text)
 {
   if (!createdL68)
     return NORMAL;
-  fprintf(listFile, text);              // write text to file
+  listBuf += text;
   return NORMAL;
 }
 
 int listObj(int data, int size)
 {
+  listObjAt = -1;
   if (!CEXflag && (listPtr - listData + size > 31)) {
+    if (!createdL68)
+      return NORMAL;
     strcpy(listData + ((size == WORD_SIZE) ? 26 : 28), "...");
+    if (onePass)
+      fixListCut((size == WORD_SIZE) ? 26 : 28);
     return NORMAL;
   }
   if (CEXflag && (listPtr - listData + size > 31)) {
@@ -229,15 +323,20 @@ int listObj(int data, int size)
     listPtr = listData + 10;
     continuation = true;
   }
+  // Without a listing only the layout is kept, as continuation lines
+  // count in the line numbers
+  if (!createdL68) {
+    listPtr += size * 2 + 1;
+    return NORMAL;
+  }
+  listObjAt = listPtr - listData;
   switch (size) {
-    case BYTE_SIZE: sprintf(listPtr, "%02X ", data & 0xFF);
-      listPtr += 3;
-      break;
-    case WORD_SIZE: sprintf(listPtr, "%04X ", data & 0xFFFF);
-      listPtr += 5;
-      break;
-    case LONG_SIZE: sprintf(listPtr, "%08lX ", data);
-      listPtr += 9;
+    case BYTE_SIZE:
+    case WORD_SIZE:
+    case LONG_SIZE:
+      listPtr = listHex(listPtr, data, size * 2);
+      *listPtr++ = ' ';
+      *listPtr = '\0';
       break;
     default: sprintf(buffer,"LISTOBJ: INVALID SIZE CODE!\n");
       return MILD_ERROR;
@@ -246,35 +345,90 @@ int listObj(int data, int size)
   return NORMAL;
 }
 
+// List count copies of data of size, as count calls of listObj() would.
+// Without CEX the line is full after a few, and the rest only repeat
+// its "...".
+int listFill(int data, int size, int count)
+{
+  bool full;
+
+  for (int i=0; i<count; i++) {
+    full = !CEXflag && (listPtr - listData + size > 31);
+    listObj(data, size);
+    if (full)
+      break;
+  }
+  return NORMAL;
+}
+
+//------------------------------------------------------------
+// Return the position in the listing of the next text listed
+long listPos()
+{
+  return listBuf.size();
+}
+
+//------------------------------------------------------------
+// Replace the count characters listed at pos with text
+void listPatch(long pos, const char *text, int count)
+{
+  listBuf.replace(pos, count, text, count);
+}
+
+//------------------------------------------------------------
+// Remove the listing from pos on
+void listCut(long pos)
+{
+  listBuf.resize(pos);
+}
+
 
 int finishList()
 {
+  char text[64];
+
   try {
+    if (noList) {                       // error messages only
+      fwrite(listBuf.data(), 1, listBuf.size(), stdout);
+      std::string().swap(listBuf);
+      return NORMAL;
+    }
     if (!createdL68)
       return NORMAL;
-    putc('\n', listFile);
-    if (errorCount > 0)
-      fprintf(listFile, "%d error%s detected\n", errorCount,
+    listBuf += '\n';
+    if (errorCount > 0) {
+      sprintf(text, "%d error%s detected\n", errorCount,
                           (errorCount > 1) ? "s" : "");
-    else {
+      listBuf += text;
+    } else {
       //***** DO NOT CHANGE THIS TEXT *****
       // "No error" is used by simulator to find the end of the code in the listing
-      fprintf(listFile, "No errors detected\n");
+      listBuf += "No errors detected\n";
     }
-    if (warningCount > 0)
-      fprintf(listFile, "%d warning%s generated\n", warningCount,
+    if (warningCount > 0) {
+      sprintf(text, "%d warning%s generated\n", warningCount,
                           (warningCount > 1) ? "s" : "");
-    else
-      fprintf(listFile, "No warnings generated\n");
+      listBuf += text;
+    } else
+      listBuf += "No warnings generated\n";
 
     // If OPT CRE Display Symbol Table ?
     if (CREflag)
       optCRE();   // Write symbol table to listing file
 
-    // write starting address to first line of file
-    rewind(listFile);                     // rewind to start of file
-    fprintf(listFile, "%08lX", startAddress);
+    // write starting address to first line of file, in place of the
+    // location of the first line
+    listHex(text, startAddress, 8);
+    listBuf.replace(0, 8, text, 8);
 
+    fwrite(listBuf.data(), 1, listBuf.size(), listFile);
+    std::string().swap(listBuf);          // free the listing
+    createdL68 = false;
+    if (ferror(listFile)) {
+      fclose(listFile);
+      sprintf(buffer,"Error writing to listing file\n");
+      return MILD_ERROR;
+    }
     fclose(listFile);
     return NORMAL;
   }
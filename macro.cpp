@@ -11,8 +11,8 @@
      Conditional assembly is supported. The syntax is:
 
     Functions: macro - Defines the macro.
-               Saves file pointer to macro, defines macro name,
-               moves file pointer past ENDM directive.
+               Stores the macro body in memory, defines macro name,
+               moves past ENDM directive.
 
                asmMacro -
                    for (each line of macro) {
@@ -21,12 +21,9 @@
                      assemble this line of macro
                    }
 
-               tokenize - Tokenize a string to tokens[].
-               Each element of token[] is a pointer to the corresponding
-               token in tokens[].  is always reserved for the label
-               if any. A value of 0 in token[] indicates no token.
-               Each token is null terminated.
-               Each token is converted to upper case.
+               Lines are split into tokens by tokenize() in ASSEMBLER.CPP.
+
+               clearMacros - Frees the stored macro bodies.
 
 
        Author: Charles Kelly
@@ -45,13 +42,14 @@
 #include <stdio.h>
 #include <ctype.h>
 #include <string.h>
+#include <string>
+#include <vector>
 #include "asm.h"
 
-extern char line[256];		// Source line
-extern FILE *inFile;            // source file
+extern char *line;		// Source line
+extern char *lineBuffer;	// buffer for lines not in a source file
 extern FILE *listFile;		// Listing file
 extern FILE *errFile;		// error message file
-extern FILE *tmpFile;
 extern bool listFlag;
 extern bool continuation;	// TRUE if the listing line is a continuation
 extern char pass;		// pass counter
@@ -67,58 +65,404 @@ extern bool skipCond;           // true skips lines in macro
 extern bool printCond;          // true to print condition on listing line
 extern int nestLevel;           // nesting level of conditional directives
 extern bool skipCreateCode;     // true to skip calling createCode during macro processing
-
-int macroFP;                    // location of current macro in tmpFile
-const int MAC_SIZE = 512;       // maximun size of macro line
+extern sourceFile *inSource;    // current source file
+extern lineIR *curIR;           // lineIR of the source line
+extern int inLine;              // index of next line of inSource
+extern int relaxCount;          // pass 1 repeats for OPT RELAX
+
+// A macro body is kept as the lines of its definition, ENDM included.
+// The folded text of a line stays in the source file cache and its
+// tokens are found once when the macro is defined. Each line is also
+// compiled into segments, so an expansion of the line joins the text
+// segments with the arguments, the \@ label and the NARG count.
+// REPT, IRP and IRPC blocks are kept the same way, without the ENDR,
+// in a body that holds a copy of their text.
+typedef struct {
+  short kind;                   // SEG_TEXT, SEG_ARG, SEG_LABEL, SEG_NARG,
+                                //   SEG_NAME or SEG_ERROR
+  short value;                  // argument number or error code
+  int start, length;            // text of the segment in the line
+} macroSegment;
+
+const short SEG_TEXT  = 0;      // text copied from the line
+const short SEG_ARG   = 1;      // \0 - \9, \A - \Z
+const short SEG_LABEL = 2;      // \@
+const short SEG_NARG  = 3;      // NARG
+const short SEG_NAME  = 4;      // \name of an IRP or IRPC symbol
+const short SEG_ERROR = 5;      // error found in the line
+
+typedef struct {
+  char *text;                   // folded text of the line
+  int length;                   // length of text
+  int segment, segments;        // first segment and number of segments
+  tokenSpan token[3];           // label, opcode and first operand
+} macroLine;
+
+typedef struct {
+  std::vector<macroLine> lines;
+  std::vector<macroSegment> segments;   // segments of all lines
+  std::vector<char> text;       // text of the lines of a block
+} macroBody;
+
+std::vector<macroBody> macroBodies;     // bodies by macro number
+
+// An expansion of a macro or block being assembled. The lines of a
+// block in an expansion are read from the expansion.
+typedef struct macroFrame {
+  int mac;                      // number of macro, or -1 for a block
+  macroBody *block;             // body of a block
+  int next;                     // next line of the body
+  std::vector<std::string> *arguments;  // \0 - \Z, \name is argument 1
+  int argN;                     // number of arguments, for NARG
+  char label[16];               // text of \@
+  int labelLength;
+  struct macroFrame *outer;     // expansion the line of this one is from
+} macroFrame;
+
+macroFrame *expansion = NULL;   // innermost expansion being assembled
+
+int macroIndex;                 // number of current macro, the macro's value
 int macroNestLevel;             // count nested macro calls
 char lineIdent[MACRO_NEST_LIMIT+2];  // "mmm" used to identify macro in listing + 1 for 's' when structured code is called from macro and +1 for '\0'
 bool noENDM;                    // set true if no ENDM in macro
 
+//--------------------------------------------------------
+// Add a segment to body, joining text segments that follow each other
+static void addSegment(macroBody &body, macroLine &mline, short kind,
+                       short value, int start, int length)
+{
+  macroSegment seg;
+
+  if (kind == SEG_TEXT && mline.segments) {
+    macroSegment &last = body.segments.back();
+    if (last.kind == SEG_TEXT && last.start + last.length == start) {
+      last.length += length;
+      return;
+    }
+  }
+  seg.kind = kind;
+  seg.value = value;
+  seg.start = start;
+  seg.length = length;
+  body.segments.push_back(seg);
+  mline.segments++;
+}
+
+// Compile mline into segments of body. A comment line is one text segment.
+// name is the symbol of an IRP or IRPC block, if any.
+static void compileMacroLine(macroBody &body, macroLine &mline, tokenSpan name)
+{
+  char *text = mline.text;
+  int i, n;
+  bool quoted = false;                  // true inside a quoted string
+
+  mline.segment = body.segments.size();
+  mline.segments = 0;
+  i = 0;
+  while (text[i] && isspace(text[i]))   // skip spaces
+    i++;
+  if (text[i] == '*') {                 // if comment line
+    addSegment(body, mline, SEG_TEXT, 0, 0, mline.length);
+    return;
+  }
+  addSegment(body, mline, SEG_TEXT, 0, 0, i);
+  while (text[i]) {
+    if (text[i] == '\\' && name.length &&
+        !strncasecmp(&text[i+1], name.start, name.length) &&
+        !(isalnum(text[i+1+name.length]) || text[i+1+name.length] == '_')) {
+      addSegment(body, mline, SEG_NAME, 0, i, name.length + 1);
+      i += name.length + 1;
+    } else if (text[i] == '\\') {       // if macro label or parameter
+      i++;
+      if (text[i] == '@') {             // if \@ macro label
+        addSegment(body, mline, SEG_LABEL, 0, i-1, 2);
+        i++;
+      } else if (isalnum(text[i])) {    // if alpha numeric
+        n = -1;
+        if (isdigit(text[i]))           // if parameter \0 - \9
+          n = text[i++] - '0';
+        else if (text[i] >= 'A' && text[i] <= 'Z')      // if parameter \A - \Z
+          n = text[i++] - 'A' + 10;
+        else                            // invalid argument
+          addSegment(body, mline, SEG_ERROR, INVALID_ARG, 0, 0);
+        if (n >= 0 && n < MAX_ARGS)     // if valid argument number
+          addSegment(body, mline, SEG_ARG, n, i-2, 2);
+        else
+          addSegment(body, mline, SEG_ERROR, INVALID_ARG, 0, 0);
+      } else
+        addSegment(body, mline, SEG_ERROR, SYNTAX, 0, 0);
+    // NARG is replaced where it is a whole word outside quotes
+    } else if (!quoted && !strncmp(&text[i], "NARG", 4) &&
+               !(isalnum(text[i+4]) || text[i+4] == '_') &&
+               !(i > 0 && (isalnum(text[i-1]) || text[i-1] == '_'))) {
+      addSegment(body, mline, SEG_NARG, 0, i, 4);
+      i += 4;
+    } else {
+      if (text[i] == '\'')              // '' in a string quotes twice
+        quoted = !quoted;
+      addSegment(body, mline, SEG_TEXT, 0, i, 1);
+      i++;
+    }
+  }
+}
+
+// Return true if segment kind is replaced in an expansion by frame f.
+// A block replaces only \@ and \name; its arguments and NARG are those
+// of the macro it is in. With keep set, \@ and \name are left for a
+// block that is read from the expansion.
+static bool replaced(macroFrame *f, short kind, bool keep)
+{
+  if (kind == SEG_LABEL || kind == SEG_NAME)
+    return !keep;
+  if (kind == SEG_ARG || kind == SEG_NARG)
+    return f->mac >= 0;
+  return false;
+}
+
+// Make the expansion of mline by frame f the source line
+static void expandLine(macroFrame *f, const macroBody &body,
+                       const macroLine &mline, bool keep, int *errorPtr)
+{
+  const macroSegment *seg = &body.segments[mline.segment];
+  const macroSegment *segEnd = seg + mline.segments;
+  std::vector<std::string> &arguments = *f->arguments;
+  char *macL;
+  int n;
+
+  line = lineBuffer;
+  curIR = NULL;                         // not a line of a source file
+  if (skipCond) {                       // if code conditionally skipped
+    lineReserve(mline.length + 1);      // just copy line to check for ENDC
+    memcpy(line, mline.text, mline.length);
+    line[mline.length] = '\0';
+    return;
+  }
+  // do macro parameter substitution and label generation
+  n = 0;
+  for (const macroSegment *s = seg; s < segEnd; s++)
+    if (!replaced(f, s->kind, keep))
+      n += s->length;
+    else if (s->kind == SEG_ARG)
+      n += arguments[s->value].size();
+    else if (s->kind == SEG_LABEL)
+      n += f->labelLength;
+    else if (s->kind == SEG_NAME)
+      n += arguments[1].size();
+    else                                // SEG_NARG
+      n += 2;
+  lineReserve(n + 1);
+  macL = line;
+  for (; seg < segEnd; seg++)
+    if (seg->kind == SEG_ERROR)
+      NEWERROR(*errorPtr, seg->value);
+    else if (!replaced(f, seg->kind, keep)) {
+      memcpy(macL, mline.text + seg->start, seg->length);
+      macL += seg->length;
+    } else if (seg->kind == SEG_ARG) {
+      memcpy(macL, arguments[seg->value].data(),
+             arguments[seg->value].size());
+      macL += arguments[seg->value].size();
+    } else if (seg->kind == SEG_LABEL) {
+      memcpy(macL, f->label, f->labelLength);
+      macL += f->labelLength;
+    } else if (seg->kind == SEG_NAME) {
+      memcpy(macL, arguments[1].data(), arguments[1].size());
+      macL += arguments[1].size();
+    } else                              // SEG_NARG
+      macL += sprintf(macL, "%d", f->argN);
+  *macL = '\0';
+}
+
+// Build the "mmm" identifier of macro lines for the listing
+static void setLineIdent()
+{
+  int i;
+
+  for (i=0; i < macroNestLevel; i++)
+    lineIdent[i] = 'm';
+  lineIdent[i] = '\0';
+}
+
+// Assemble the lines of the body of expansion f
+static void runBody(macroFrame *f, int *errorPtr)
+{
+  macroLine mline;
+  tokenSpan *token;               // tokens of macro line
+  int error;
+  int value;
+  bool backRef;
+  macroFrame *m;                  // frame whose arguments IFARG tests
+  bool endmFlag;                  // set true by ENDM instruction
+
+  macroFrame *outer = expansion;
+  expansion = f;
+  endmFlag = false;
+  f->next = 0;
+  while (!endmFlag) {
+    // A macro definition in the macro may add a body, so the body is
+    // indexed again for each line.
+    macroBody &body = (f->mac >= 0) ? macroBodies[f->mac] : *f->block;
+    if (f->next >= (int) body.lines.size())
+      break;
+    mline = body.lines[f->next++];
+    token = mline.token;
+
+    // The macro line replaces the source line
+    error = OK;
+    skipList = false;
+    printCond = false;
+    expandLine(f, body, mline, false, &error);
+
+    continuation = false;
+    if (!MEXflag)
+      skipList = true;
+
+    skipCreateCode = false;
+
+    // pre process macro commands
+    // ----- ENDM and MEXIT -----
+    if( (tokenIs(token[1], "ENDM") && f->mac >= 0) ||   // if ENDM opcode or
+        (tokenIs(token[1], "MEXIT")) && !skipCond) { // MEXIT
+      if (token[0].start != empty)                    // if label present
+        NEWERROR(*errorPtr, LABEL_ERROR);
+      endmFlag = true;
+      skipCreateCode = true;
+
+    // ----- IFARG -----
+    } else if(tokenIs(token[1], "IFARG")) {  // if IFARG opcode
+      for (m = f; m && m->mac < 0; m = m->outer) // arguments are the macro's
+        ;
+      if (token[0].start != empty)                    // if label present
+        NEWERROR(*errorPtr, LABEL_ERROR);
+      if (token[2].start == empty) {                  // if IFARG argument missing
+        NEWERROR(*errorPtr, INVALID_ARG);
+      } else {
+        eval(token[2].start, &value, &backRef, &error);
+        //value--;
+        if (error < ERRORN && m && value > 0 && value < MAX_ARGS) { // if valid arg number
+          if ((*m->arguments)[value].empty()) { // if argument does not exist
+            skipCond = true;                // skip lines in macro
+            nestLevel++;                    // nest level of skip
+          }
+        } else {                            // else, invalid arg number
+          NEWERROR(*errorPtr, INVALID_ARG);
+        }
+      }
+      printCond = true;
+      skipCreateCode = true;
+    }
+
+    if(!noENDM)                 // if no missing ENDM errors
+      assemble(line,&error);    // this supports structured statements in macros
+
+  } // end while more lines of macro remain
+  expansion = outer;
+
+  skipCreateCode = false;
+}
+
+// Parse one macro argument at capL into arg. Returns a pointer to the
+// character after the argument.
+static char *parseArgument(char *capL, std::string &arg)
+{
+  bool textArg;                         // true for 'text' argument
+
+  textArg = false;
+  while ( *capL && ( (*capL != ',' && !(isspace(*capL)) ) || textArg )) {
+    if (*capL == '<') {                 // if <         *ck 12-7-2005
+      if (!textArg)                     // if not text mode
+        textArg = true;                 // set text mode flag
+      else if (arg.size() < ARG_SIZE)
+        arg += *capL;                   // copy < to argument
+    } else if (*capL == '>') {
+      if (textArg)                      // if text mode
+        textArg = false;                // turn off text mode
+      else if (arg.size() < ARG_SIZE)
+        arg += *capL;                   // copy > to argument
+    } else if (!textArg && (*capL == '\'' && *(capL+1) == '\'')) // if ''
+      capL++;                           // skip ' (NULL Argument)
+    else if (arg.size() < ARG_SIZE && *capL != '\n')
+      arg += *capL;                     // put argument in arguments[]
+    capL++;
+  }
+  return capL;
+}
+
 //--------------------------------------------------------
 // Define macro
-// Save file pointer to macro, define macro name, move file pointer
-//  past ENDM directive.
+// Store the macro body, define macro name, move past ENDM directive.
 int macro(int size, char *label, char *op, int *errorPtr)
 {
   symbolDef *symbol;
   int error;
   const int MAXT = 128;           // maximum number of tokens
-  char *token[MAXT];              // pointers to tokens
-  char tokens[MAC_SIZE];          // place tokens here
+  tokenSpan token[MAXT];          // tokens of line
+  tokenSpan noName = { empty, 0 };
+  macroLine mline;
+  lineIR *ir = curIR;             // lineIR of MACRO if it is a source line
+  bool newBody = false;           // true to store the body
 
   if (size)
     NEWERROR(*errorPtr, INV_SIZE_CODE);
   error = OK;
 
-  fseek(tmpFile,0,SEEK_END);    // prepare tmpFile to receive next macro
-
-  if (pass == 0)
-    macroFP = ftell(tmpFile);           // save location of macro in tempFile
-  // put macro and it's file pointer in symbol table
-  symbol = define(label, macroFP, pass2, true, &error);
+  if (pass == 0) {
+    // a repeated pass 1 keeps the body stored by the first one
+    symbol = (relaxCount) ? macroLookup(label, strlen(label),
+                                        hash(label, strlen(label))) : NULL;
+    if (symbol && (symbol->flags & MACRO_SYM))
+      macroIndex = symbol->value;
+    else {
+      macroIndex = macroBodies.size();  // number of new macro body
+      macroBodies.push_back(macroBody());
+      newBody = true;
+    }
+  }
+  // put macro and it's body number in symbol table
+  symbol = define(label, macroIndex, pass2, true, &error);
   if (error == MULTIPLE_DEFS) {         // ignore all errors except MULTIPLE_DEFS
     NEWERROR(*errorPtr, MULTIPLE_DEFS);
     return NORMAL;
   }
   symbol->flags |= MACRO_SYM;         // set MACRO_SYM flag
+  if (*label != '.')                  // local labels are not macro names
+    addMacro(symbol);
 
   if (pass2 && listFlag)
     listLine(line, "\0");
 
-  // move file pointer past ENDM directive
-  while(fgets(line, 256, inFile)) {
-    if (pass == 0)
-      fprintf(tmpFile, line);           // write macro line to tmpFile
+  // the body was read in pass 1, move straight to ENDM
+  if (!newBody && ir && ir->skip > 0) {
+    if (pass2 && listFlag)
+      for (int i=inLine; i<inLine+ir->skip-1; i++)
+        listLine(inSource->text + inSource->lineStart[i], "\0");
+    inLine += ir->skip - 1;
+    lineNum += ir->skip;
+    nextLine();                         // ENDM
+    return NORMAL;
+  }
+
+  // move past ENDM directive
+  while(nextLine()) {
     lineNum++;
-    char temptext[] = " \t\n";
-    tokenize(line, temptext, token, tokens);
-    if(!(strcasecmp(token[1], "MACRO"))) { // if unexpected MACRO opcode
+    mline.text = inSource->folded + (line - inSource->text);
+    tokenize(mline.text, SPACE_DELIMS, token, NULL);
+    if (newBody) {                      // add line to macro body
+      mline.length = strlen(mline.text);
+      memcpy(mline.token, token, sizeof(mline.token));
+      compileMacroLine(macroBodies[macroIndex], mline, noName);
+      macroBodies[macroIndex].lines.push_back(mline);
+    }
+    if(tokenIs(token[1], "MACRO")) {    // if unexpected MACRO opcode
       NEWERROR(*errorPtr, NO_ENDM);     // no ENDM found
       noENDM = true;
       return 0;
     }
-    if(!(strcasecmp(token[1], "ENDM")))     // if ENDM opcode
+    if(tokenIs(token[1], "ENDM")) {     // if ENDM opcode
+      if (ir)                           // lines to ENDM, for pass 2
+        ir->skip = inLine - (ir - inSource->ir) - 1;
       return NORMAL;
+    }
     if (pass2 && listFlag)
       listLine(line, "\0");
   }
@@ -130,7 +474,7 @@ int macro(int size, char *label, char *op, int *errorPtr)
 
 //--------------------------------------------------------
 // Assemble macro
-// pre: macroFP contains file pointer to macro
+// pre: macroIndex contains number of macro
 // for (each line of macro) {
 //   if macro label, define
 //   perform parameter substitution
@@ -138,40 +482,27 @@ int macro(int size, char *label, char *op, int *errorPtr)
 // }
 int asmMacro(int size, char *label, char *arg, int *errorPtr)
 {
-  char capLine[256], macLine[MAC_SIZE], labelNumA[16];
-  char *capL, *macL;
-  char arguments[MAX_ARGS][ARG_SIZE+1];
-  const int MAXT = 128;           // maximum number of tokens
-  const int MAX_SIZE = 512;       // maximun size of input line
-  char *token[MAXT];              // pointers to tokens
-  char tokens[MAX_SIZE];          // place tokens here
-  char *tokenEnd[MAXT];           // where tokens end in source line
-  int error, argN, i, n;
-  int tempFP;                           // temporary File Pointer
-  int value;
-  bool backRef;
-  bool textArg;                         // true for 'text' argument
-  bool endmFlag;                  // set true by ENDM instruction
-
-  // clear arguments[] array
-  for (argN=0; argN < MAX_ARGS; argN++) // for all of arguments[] array
-    arguments[argN][0] = '\0';
+  std::vector<char> capLine;             // folded copy of line
+  char *capL;
+  std::vector<std::string> arguments(MAX_ARGS);  // arguments of the call
+  macroFrame frame;
+  int argN;
 
   // *ck 12-6-2005 added following to support size extensions on macro calls.
   // Argument \0 is reserved for size and defaults to .W
 
   switch (size) {
     case BYTE_SIZE:
-      strcpy(arguments[0],"B");
+      arguments[0] = "B";
       break;
     case WORD_SIZE:
-      strcpy(arguments[0],"W");
+      arguments[0] = "W";
       break;
     case LONG_SIZE:
-      strcpy(arguments[0],"L");
+      arguments[0] = "L";
       break;
     default:
-      strcpy(arguments[0],"W");
+      arguments[0] = "W";
   }
   argN = 0;
 
@@ -183,41 +514,21 @@ int asmMacro(int size, char *label, char *arg, int *errorPtr)
   }
 
   // build macro "mmm" identifier for listing
-  for (i=0; i < macroNestLevel; i++)
-    lineIdent[i] = 'm';
-  lineIdent[i] = '\0';
+  setLineIdent();
 
   // Define the label attached to this macro call, if any
   if (*label)
     define(label, loc, pass2, true, errorPtr);
 
   // parse macro call and put arguments into array
-  strcap(capLine, arg);
-  capL = capLine;
+  capLine.resize(strlen(arg) + 1);
+  strcap(capLine.data(), arg);
+  capL = capLine.data();
   if (*capL)
     argN = 1;
 
   while (*capL) {                       // loop until out of arguments
-    i = 0;
-    textArg = false;
-    while ( *capL && ( (*capL != ',' && !(isspace(*capL)) ) || textArg )) {
-      if (*capL == '<') {               // if <         *ck 12-7-2005
-        if (!textArg)                   // if not text mode
-          textArg = true;               // set text mode flag
-        else
-          arguments[argN][i++] = *capL; // copy < to argument
-      } else if (*capL == '>') {
-        if (textArg)                    // if text mode
-          textArg = false;              // turn off text mode
-        else
-          arguments[argN][i++] = *capL; // copy > to argument
-      } else if (!textArg && (*capL == '\'' && *(capL+1) == '\'')) // if ''
-        capL++;                         // skip ' (NULL Argument)
-      else if (i < ARG_SIZE && *capL != '\n')
-        arguments[argN][i++] = *capL;   // put argument in arguments[]
-      capL++;
-    }
-    arguments[argN][i] = '\0';          // terminate argument
+    capL = parseArgument(capL, arguments[argN]);
 
     if (*capL == ',') {                 // if more arguments remain
       capL++;                           // skip ','
@@ -233,14 +544,14 @@ int asmMacro(int size, char *label, char *arg, int *errorPtr)
           }
         }
 
-        if (fgets(line, 256, inFile) == NULL) {      // get next line
+        if (nextLine() == NULL) {      // get next line
           NEWERROR(*errorPtr, INVALID_ARG);
           macroNestLevel--;               // count nested macro calls
           return NORMAL;
         }
-        strcap(capLine, line);
-        capL = capLine;
-        error = OK;
+        capLine.resize(strlen(line) + 1);
+        strcap(capLine.data(), line);
+        capL = capLine.data();
         continuation = false;
 
         if (pass2 && listFlag)
@@ -274,143 +585,248 @@ int asmMacro(int size, char *label, char *arg, int *errorPtr)
     listLine(line, lineIdent);
   }
 
-  // position tempFile to macro definition
-  fseek(tmpFile, macroFP, SEEK_SET);   // move to macro definition
-
   // send each line of macro to assembler
+  frame.mac = macroIndex;
+  frame.block = NULL;
+  frame.arguments = &arguments;
+  frame.argN = argN;
   labelNum++;                           // increment macro label number
-    std::string str = std::to_string(labelNum);
-    std::copy(str.begin(), str.end(), labelNumA);
-    labelNumA[str.size()] = '\0'; // Add null terminator for C-style string
-   // convert labelNum to string
-  endmFlag = false;
-  while(!endmFlag && fgets(line, 256, tmpFile)) {
-    strcap(capLine, line);
-    char temptext[] = " \t\n";
-    tokenize(capLine, temptext, token, tokens); // tokenize line
+  frame.labelLength = sprintf(frame.label, "_%d", labelNum);  // \@ label text
+  runBody(&frame, errorPtr);
 
-    error = OK;
-    skipList = false;
-    printCond = false;
-    macL = macLine;
-    capL = capLine;
-    while(*capL && isspace(*capL))              // copy spaces
-      *macL++ = *capL++;
-    if (*capL == '*') {                         // if comment line
-      while(*capL)                              // copy rest of line
-        *macL++ = *capL++;
-    } else {                                    // else not comment line
-
-      if (skipCond)                     // if code conditionally skipped
-        while(*capL)
-          *macL++ = *capL++;            // just copy line to check for ENDC
-      else {                            // else, include code
-        // do macro parameter substitution and label generation
-        while (*capL) {                         // while not empty
-          while (*capL && !(isspace(*capL))) {  // while not empty and not space
-            if (*capL == '\\') {                // if macro label or parameter
-              capL++;
-              if (*capL == '@') {               // if \@ macro label
-                capL++;
-                *macL++ = '_';                  // add '_'
-                i = 0;                          // add labelNum to macro label
-                while(labelNumA[i]) {
-                  *macL++ = labelNumA[i++];
-                }
-              } else if (isalnum(*capL)) {      // if alpha numeric
-                n = -1;
-                if (isdigit(*capL))             // if parameter \0 - \9
-                  n = *capL++ - '0';         // convert parameter to integer
-                else if (*capL >= 'A' && *capL <= 'Z')  // if parameter \A - \Z
-                  n = *capL++ - 'A' + 10;    // convert parameter to integer
-                else                            // invalid argument
-                  NEWERROR(error, INVALID_ARG);
-                if (n >= 0 && n < MAX_ARGS) {   // if valid argument number
-                  i = 0;
-                  while(arguments[n][i]) {
-                    *macL++ = arguments[n][i++];
-                  }
-                } else
-                  NEWERROR(error, INVALID_ARG);
-              } else
-                NEWERROR(error, SYNTAX);
-            // if NARG opcode
-            //} else if( !(strcasecmp(token[1], "NARG")) ) {
-            } else if( !(strcasecmp(capL, "NARG")) && !(isalnum(*(capL+4))) ) {            
-              sprintf(macL,"%d",argN);
-              if (argN > 9)
-                macL++;
-              macL++;
-              capL += 4;
-            } else {
-              *macL++ = *capL++;        // copy macro line
-            }
-          }
-          while(*capL && isspace(*capL))  // copy spaces
-            *macL++ = *capL++;
-        }
-      } // end else, include code
-    } // end if comment, else not comment
+  macroNestLevel--;             // count nested macro calls
+  // build macro "mmm" identifier for listing
+  setLineIdent();
 
-    *macL = '\0';
+  skipList = true;              // don't display ENDM twice
+  return NORMAL;
+}
 
-    tempFP = ftell(tmpFile); // save current file position to support nested macros *ck 12-1-2005
-    continuation = false;
-    strcpy(line,macLine);   // replace original source line with macro line
-    if (!MEXflag)
-      skipList = true;
+//--------------------------------------------------------
+// REPT, IRP and IRPC blocks
+//
+//       REPT    count           IRP     name,item,item...     IRPC    name,text
+//       ...                     ...                           ...
+//       ENDR                    ENDR                          ENDR
+//
+// The lines of a block are read once and assembled count times, once
+// for each item, or once for each character of text. \name in the lines
+// is replaced by the item or character and \@ gives a label of its own
+// in each repetition. Blocks may be nested and may be used in macros.
+
+// Read the lines of a block up to its ENDR into block. The lines come
+// from the expansion the block is in, or else from the source file.
+// Returns false if there is no ENDR.
+static bool readBlock(macroBody &block, tokenSpan name, int *errorPtr)
+{
+  const int MAXT = 128;           // maximum number of tokens
+  tokenSpan token[MAXT];          // tokens of line
+  std::vector<int> start;         // offset of each line in block.text
+  macroFrame *f = NULL;
+  macroBody temp;                 // line of f compiled for the block
+  macroLine mline;
+  char *text;
+  int depth = 1, i;
+
+  if (expansion && line == lineBuffer)  // if block is in an expansion
+    f = expansion;
+  if (pass2 && listFlag && !skipList)
+    listLine(line, lineIdent);
+  while (true) {
+    if (f) {                            // next line of the expansion
+      macroBody &body = (f->mac >= 0) ? macroBodies[f->mac] : *f->block;
+      if (f->next >= (int) body.lines.size())
+        return false;
+      mline = body.lines[f->next++];
+      if (tokenIs(mline.token[1], "ENDM") && f->mac >= 0) {
+        f->next--;                      // leave ENDM to the macro
+        return false;
+      }
+      // substitute the arguments of f but leave \@ and \name to the block
+      temp.segments.clear();
+      compileMacroLine(temp, mline, name);
+      expandLine(f, temp, mline, true, errorPtr);
+      text = line;
+    } else {                            // next line of the source file
+      if (!nextLine())
+        return false;
+      lineNum++;
+      text = inSource->folded + (line - inSource->text);
+    }
+    tokenize(text, SPACE_DELIMS, token, NULL);
+    if (pass2 && listFlag && !skipList)
+      listLine(line, lineIdent);
+    if (tokenIs(token[1], "REPT") || tokenIs(token[1], "IRP") ||
+        tokenIs(token[1], "IRPC"))
+      depth++;
+    else if (tokenIs(token[1], "ENDR") && --depth == 0)
+      break;
+    start.push_back(block.text.size());
+    block.text.insert(block.text.end(), text, text + strlen(text) + 1);
+  }
 
-    skipCreateCode = false;
+  // the text is complete, compile its lines
+  for (i=0; i < (int) start.size(); i++) {
+    mline.text = block.text.data() + start[i];
+    mline.length = strlen(mline.text);
+    tokenize(mline.text, SPACE_DELIMS, token, NULL);
+    memcpy(mline.token, token, sizeof(mline.token));
+    compileMacroLine(block, mline, name);
+    block.lines.push_back(mline);
+  }
+  return true;
+}
 
-    // pre process macro commands
-    // ----- ENDM and MEXIT -----
-    if( !(strcasecmp(token[1], "ENDM")) ||         // if ENDM opcode or
-        (!(strcasecmp(token[1],"MEXIT"))) && !skipCond) { // MEXIT
-      if (token[0] != empty)                    // if label present
-        NEWERROR(*errorPtr, LABEL_ERROR);
-      endmFlag = true;
-      skipCreateCode = true;
+// Assemble block once for each of items, or count times if items is NULL
+static void runBlock(macroBody &block, std::vector<std::string> *items,
+                     int count, int *errorPtr)
+{
+  std::vector<std::string> arguments(2);        // \name is argument 1
+  macroFrame frame;
+  int i;
 
-    // ----- IFARG -----
-    } else if(!(strcasecmp(token[1], "IFARG"))) {  // if IFARG opcode
-      if (token[0] != empty)                    // if label present
-        NEWERROR(*errorPtr, LABEL_ERROR);
-      if (token[2] == empty) {                  // if IFARG argument missing
-        NEWERROR(*errorPtr, INVALID_ARG);
-      } else {
-        eval(token[2], &value, &backRef, &error);
-        //value--;
-        if (error < ERRORN && value > 0 && value < MAX_ARGS) { // if valid arg number
-          if (arguments[value][0] == '\0') { // if argument does not exist
-            skipCond = true;                // skip lines in macro
-            nestLevel++;                    // nest level of skip
-          }
-        } else {                            // else, invalid arg number
-          NEWERROR(*errorPtr, INVALID_ARG);
-        }
-      }
-      printCond = true;
-      skipCreateCode = true;
-    }
+  macroNestLevel++;                     // count nested expansions
+  if (macroNestLevel > MACRO_NEST_LIMIT) {  // if nested too deep
+    NEWERROR(*errorPtr, MACRO_NEST);
+    macroNestLevel--;
+    return;
+  }
+  setLineIdent();
+
+  frame.mac = -1;
+  frame.block = &block;
+  frame.arguments = &arguments;
+  frame.argN = 0;
+  if (items)
+    count = items->size();
+  for (i=0; i < count; i++) {
+    if (items)
+      arguments[1] = (*items)[i];
+    labelNum++;                         // \@ label of this repetition
+    frame.labelLength = sprintf(frame.label, "_%d", labelNum);
+    runBody(&frame, errorPtr);
+  }
 
-    if(!noENDM)                 // if no missing ENDM errors
-      assemble(line,&error);    // this supports structured statements in macros
+  macroNestLevel--;
+  setLineIdent();
+  skipList = true;              // don't display the last line twice
+}
 
-    macroFP = tempFP;       // restore macroFP
-    fseek(tmpFile, macroFP, SEEK_SET);      // position tmpFile to previous spot *ck 12-1-2005
+// Parse the name of an IRP or IRPC block at op into name. Returns a
+// pointer to the text after the ',', or NULL if there is no name.
+static char *blockName(char *op, tokenSpan *name)
+{
+  char *p = op;
+
+  while (isalnum(*p) || *p == '_')
+    p++;
+  if (p == op || !isalpha(*op) || *p != ',') {
+    name->start = empty;
+    name->length = 0;
+    return NULL;
+  }
+  name->start = op;
+  name->length = p - op;
+  return p + 1;
+}
 
-  } // end while more lines of macro remain
+// REPT count
+int rept(int size, char *label, char *op, int *errorPtr)
+{
+  macroBody block;
+  tokenSpan noName = { empty, 0 };
+  int count = 0;
+  bool backRef;
 
-  skipCreateCode = false;
+  if (size)
+    NEWERROR(*errorPtr, INV_SIZE_CODE);
+  if (*label)
+    define(label, loc, pass2, true, errorPtr);
+  // the count must be known in pass 1 so both passes repeat the same lines
+  op = eval(op, &count, &backRef, errorPtr);
+  if (*errorPtr < SEVERE && !backRef)
+    NEWERROR(*errorPtr, INV_FORWARD_REF);
+  else if (op && !isspace(*op) && *op)
+    NEWERROR(*errorPtr, SYNTAX);
+  else if (*errorPtr < ERRORN && count < 0)
+    NEWERROR(*errorPtr, INV_LENGTH);
+
+  if (!readBlock(block, noName, errorPtr)) {
+    NEWERROR(*errorPtr, NO_ENDR);
+    return NORMAL;
+  }
+  skipList = true;              // ENDR is already listed
+  if (*errorPtr < ERRORN)
+    runBlock(block, NULL, count, errorPtr);
+  return NORMAL;
+}
 
-  macroNestLevel--;             // count nested macro calls
-  // build macro "mmm" identifier for listing
-  for (i=0; i < macroNestLevel; i++)
-    lineIdent[i] = 'm';
-  lineIdent[i] = '\0';
+// IRP name,item,item...
+int irp(int size, char *label, char *op, int *errorPtr)
+{
+  macroBody block;
+  std::vector<std::string> items;
+  tokenSpan name;
 
-  skipList = true;              // don't display ENDM twice
+  if (size)
+    NEWERROR(*errorPtr, INV_SIZE_CODE);
+  if (*label)
+    define(label, loc, pass2, true, errorPtr);
+  op = blockName(op, &name);
+  if (!op)
+    NEWERROR(*errorPtr, INVALID_ARG);
+  else
+    while (*op && !isspace(*op)) {      // items are parsed like macro arguments
+      items.push_back(std::string());
+      op = parseArgument(op, items.back());
+      if (*op == ',')
+        op++;
+    }
+
+  if (!readBlock(block, name, errorPtr)) {
+    NEWERROR(*errorPtr, NO_ENDR);
+    return NORMAL;
+  }
+  skipList = true;              // ENDR is already listed
+  if (*errorPtr < ERRORN)
+    runBlock(block, &items, 0, errorPtr);
   return NORMAL;
 }
 
+// IRPC name,text
+int irpc(int size, char *label, char *op, int *errorPtr)
+{
+  macroBody block;
+  std::vector<std::string> items;
+  std::string text;
+  tokenSpan name;
 
+  if (size)
+    NEWERROR(*errorPtr, INV_SIZE_CODE);
+  if (*label)
+    define(label, loc, pass2, true, errorPtr);
+  op = blockName(op, &name);
+  if (!op)
+    NEWERROR(*errorPtr, INVALID_ARG);
+  else {
+    parseArgument(op, text);
+    for (char c : text)                 // one item for each character
+      items.push_back(std::string(1, c));
+  }
+
+  if (!readBlock(block, name, errorPtr)) {
+    NEWERROR(*errorPtr, NO_ENDR);
+    return NORMAL;
+  }
+  skipList = true;              // ENDR is already listed
+  if (*errorPtr < ERRORN)
+    runBlock(block, &items, 0, errorPtr);
+  return NORMAL;
+}
+
+//--------------------------------------------------------
+// Free the stored macro bodies
+void clearMacros()
+{
+  macroBodies.clear();
+}
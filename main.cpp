@@ -1,6 +1,10 @@
 #include "proto.h"
 #include "asm.h"
 #include <iostream>
+#include <vector>
+#include <string.h>
+#include <stdlib.h>
+#include <strings.h>
 
 /***********************************************************************
  *
@@ -11,28 +15,104 @@
  *
  ************************************************************************/
 
+extern int srecSize;            // largest byte count of an S-record
+extern bool s68Flag, binFlag, hexFlag;  // object code files desired
+extern unsigned int binBase, binSize;   // part of the image in the binary file
+extern bool binBaseSet, binSizeSet;
+extern int binFill;             // binary file byte where no code is output
+extern char *deltaName;         // previous S-Record file for -d, or NULL
+extern bool noList;             // true if no listing is wanted (-n)
+extern bool tryOnePass;         // true to try one pass assembly first (-1)
+
+// Read a number in decimal, in hex after $ or 0x, or in octal after 0
+static bool number(const char *arg, unsigned int *value){
+    char *end;
+    if (*arg == '$')
+        *value = strtoul(++arg, &end, 16);
+    else
+        *value = strtoul(arg, &end, 0);
+    return *arg && !*end;
+}
+
+// Select the object code files from a list such as "s68,bin,hex"
+static bool formats(char *arg){
+    s68Flag = binFlag = hexFlag = false;
+    for (char *f = strtok(arg, ","); f; f = strtok(NULL, ",")) {
+        if (strcasecmp(f, "s68") == 0)
+            s68Flag = true;
+        else if (strcasecmp(f, "bin") == 0)
+            binFlag = true;
+        else if (strcasecmp(f, "hex") == 0)
+            hexFlag = true;
+        else
+            return false;
+    }
+    return true;
+}
+
 int main(int argc, char **argv){
 
-    if(argc < 2){
-        std::cout << "usage: \n" << "./rigel68K [sourceFile] [output name] \n" << "example : ./rigel68K source.X68 output" << std::endl; 
+    std::vector<char *> names;  // source file and output name
+    unsigned int value;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            srecSize = atoi(argv[++i]);
+            if (srecSize < 9 || srecSize > SREC_MAX) {
+                std::cout << "-s: S-record length must be 9 to " << SREC_MAX << std::endl;
+                return -1;
+            }
+        } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            if (!formats(argv[++i])) {
+                std::cout << "-f: formats are s68, bin and hex, separated by commas" << std::endl;
+                return -1;
+            }
+        } else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            if (!number(argv[++i], &value) || value > 0xFF) {
+                std::cout << "-p: fill byte must be 0 to $FF" << std::endl;
+                return -1;
+            }
+            binFill = value;
+        } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            if (!number(argv[++i], &binBase)) {
+                std::cout << "-b: base address must be a number" << std::endl;
+                return -1;
+            }
+            binBaseSet = true;
+        } else if (strcmp(argv[i], "-z") == 0 && i + 1 < argc) {
+            if (!number(argv[++i], &binSize)) {
+                std::cout << "-z: binary size must be a number" << std::endl;
+                return -1;
+            }
+            binSizeSet = true;
+        } else if (strcmp(argv[i], "-n") == 0) {
+            noList = true;
+        } else if (strcmp(argv[i], "-1") == 0) {
+            tryOnePass = true;
+        } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            deltaName = argv[++i];
+        } else
+            names.push_back(argv[i]);
+    }
+
+    if(names.size() < 1){
+        std::cout << "usage: \n" << "./rigel68K [-s length] [-f formats] [-p fill] [-b base] [-z size] [-d previous.S68] [-n] [-1] [sourceFile] [output name] \n" << "example : ./rigel68K source.X68 output" << std::endl; 
 
         return -1;
     }
 
 
-    char tempName[] = "./tempAXZE1D12398U.X68";
     std::string outputName;
-    if(argc < 3){
+    if(names.size() < 2){
         outputName = "genesis";
     }else{
-        outputName = argv[2];
+        outputName = names[1];
     }
 
 
 
     std::string workingDir = "./";
 
-    int result = assembleFile(argv[1], tempName, outputName ,workingDir);
+    int result = assembleFile(names[0], outputName ,workingDir);
     if(result){
         std::cout << "usage: \n" << "./rigel68K [sourceFile]  \n" << std::endl; 
         return -1;
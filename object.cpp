@@ -8,15 +8,18 @@
  *		the file cannot be opened, then the routine prints a
  *		message and exits. 
  *
+ *		initBin(), initIntel()
+ *		Open the binary and the Intel HEX object code files,
+ *		which finishObj() writes from the same memory image as
+ *		the S-records.
+ *
  *		outputObj()
  *		Places the data whose size, value, and address are
- *		specified in the object code file. If the new data
- *		would cause the current S-record to exceed a certain
- *		length, or if the address of the current item doesn't
- *		follow immediately after the address of the previous
- *		item, then the current S-record is written to the file
- *		(using writeObj) and a new S-record is started,
- *		beginning with the specified data.
+ *		specified in the memory image of the object code. The
+ *		image is kept in pages of memory, so code output by
+ *		ORG or SECTION to scattered addresses takes only the
+ *		pages it uses. If the data is output over data output
+ *		earlier, objOverlap is set for assemble() to report.
  *
  *		writeObj()
  *		Writes the current S-record to the object code file.
@@ -25,19 +28,68 @@
  *		during the writing, the routine prints a message and
  *		exits. 
  *
+ *		fillObj()
+ *		Outputs a block of copies of the same data as
+ *		outputObj() would.
+ *
+ *		blockObj()
+ *		Outputs a block of bytes as outputObj() would.
+ *
+ *		patchObj()
+ *		Replaces data output earlier, without reporting it.
+ *
+ *		clearObj()
+ *		Removes all data from the memory image.
+ *
  *		finishObj()
- *		Flushes the S-record buffer by writing out the data in
- *		it (using writeObj), if any, then writes a termination
+ *		Writes the memory image in address order, each
+ *		contiguous run of bytes in as few S-records as it fits
+ *		in (using writeObj), then writes a termination
  *		S-record and closes the object code file. If an error 
  *		occurs during this write, the routine prints a messge
- *		and exits.
+ *		and exits. The binary file gets the bytes of the image
+ *		from the lowest to the highest address output, or
+ *		binSize bytes from binBase, with binFill where no code
+ *		is output. The Intel HEX file gets data records of at
+ *		most 16 bytes, extended linear address records and a
+ *		start linear address record.
+ *
+ *		loadDelta(), initDelta()
+ *		Read the image of the previous build from its S-record
+ *		file and open the delta files. finishObj() then writes
+ *		only the ranges of bytes that changed, as S-records and
+ *		as binary patch ranges, and prints the ranges.
  *
  *	 Usage: initObj(name)
  *		char *name;
  *
+ *		initBin(name)
+ *		char *name;
+ *
+ *		initIntel(name)
+ *		char *name;
+ *
+ *		loadDelta(name)
+ *		char *name;
+ *
+ *		initDelta(recordName, patchName)
+ *		char *recordName, *patchName;
+ *
  *		outputObj(newAddr, data, size)
  *		int data, size;
  *
+ *		fillObj(newAddr, data, size, count)
+ *		int newAddr, data, size, count;
+ *
+ *		blockObj(newAddr, data, count)
+ *		int newAddr, count;
+ *		const unsigned char *data;
+ *
+ *		patchObj(addr, data, size)
+ *		int addr, data, size;
+ *
+ *		clearObj()
+ *
  *		writeObj()
  *
  *		finishObj()
@@ -98,15 +150,26 @@ target system it is the responsibility of the transmitting program to provide th
 
 
 #include <stdio.h>
+#include <string.h>
 #include <ctype.h>
+#include <map>
+#include <vector>
 #include "asm.h"
 
-/* Define the maximum number of bytes (address, data,
-   and checksum) that can be in one S-record */
-#define SRECSIZE  36
+/* The maximum number of bytes (address, data, and checksum) that can be
+   in one S-record, from 9 to SREC_MAX. Set by the -s option. */
+int srecSize = 36;
+
+/* The binary file holds binSize bytes of the image from binBase, set by
+   the -b and -z options, with binFill (-p) in the bytes not output */
+unsigned int binBase, binSize;
+bool binBaseSet, binSizeSet;
+int binFill = 0xFF;
 
-extern char line[256];
+extern char *line;
 extern FILE *objFile;
+extern FILE *binFile;
+extern FILE *hexFile;
 extern char buffer[256];  //ck used to form messages for display in windows
 extern char numBuf[20];
 extern unsigned int startAddress;     // starting address of program
@@ -121,23 +184,102 @@ extern int mapProtectedStart, mapProtectedEnd;
 extern bool mapInvalid;
 extern int mapInvalidStart, mapInvalidEnd;
 
-static char sRecord[80], *objPtr;
-static char byteCount, checksum;
+static char sRecord[SREC_MAX*2 + 8], *objPtr;
+static int byteCount;
+static int recordSum;           // sum of the address and data bytes
 static bool lineFlag;
-static int objAddr;
+int objDataAt;                  // address of last outputObj() data, or -1
+bool objOverlap;                // set when data is output over earlier data
+static unsigned int objAddr;
 static char objErrorMsg[] = "Error writing to object file\n";
+static FILE *recordFile;        // file writeObj() writes to
+
+// The object code is kept in a sparse memory image of pages, by page
+// number, until finishObj() writes it in address order
+const int OBJPAGEBITS = 12;
+const int OBJPAGE = 1 << OBJPAGEBITS;   // bytes in a page of the image
+struct objPage {
+  unsigned char data[OBJPAGE];
+  unsigned char used[OBJPAGE];          // 1 if the byte was output
+};
+static std::map<unsigned int, objPage *> objImage;
+static unsigned int lastPageNum;
+static objPage *lastPage;               // page of the last data output
+
+static char hexByte[256][2];    // two hex digits of each byte value
+static signed char hexValue[256];       // value of each hex digit, or -1
+const int OBJBUFSIZE = 65536;   // bytes buffered before each write
+
+const int INTELSIZE = 16;       // data bytes in an Intel HEX record
+static unsigned char intelData[INTELSIZE];      // record being built
+static unsigned int intelAddr;  // address of intelData[0]
+static int intelCount;          // bytes in intelData
+static unsigned int intelUpper; // upper 16 bits of the record addresses
+static bool intelUpperSet;
+
+// -d compares the image with that of the previous build, read from its
+// S-record file, and writes only the ranges of bytes that changed
+char *deltaName;                // previous S-record file, or NULL
+static std::map<unsigned int, objPage *> prevImage;
+const unsigned int DELTAGAP = 16;       // unchanged bytes a range may span
+struct deltaRange {
+  unsigned int start, end;      // addresses of the range, end excluded
+};
+static std::vector<deltaRange> deltaRanges;
+static bool deltaJoin;          // true if a change may join the last range
+static unsigned int deltaEnd;   // address after the last run compared
+static FILE *deltaFile;         // changed S-records
+static FILE *patchFile;         // changed binary ranges
+static unsigned int patchCount; // bytes in the patch range being written
+static bool patchStarted;       // true once its address and count are written
 
 
 //------------------------------------------------------------
-// Output S0-record file header
-int initObj(char *name)
+// Fill in the hex tables
+static void initHex()
 {
-  objFile = fopen(name, "w");
-  if (!objFile) {
-    sprintf(buffer,"Unable to create S-Record file");
-    return MILD_ERROR;
+  static const char digit[] = "0123456789ABCDEF";
+
+  for (int i=0; i<256; i++) {
+    hexByte[i][0] = digit[i >> 4];
+    hexByte[i][1] = digit[i & 0xF];
+    hexValue[i] = -1;
+  }
+  for (int i=0; i<16; i++) {
+    hexValue[(unsigned char) digit[i]] = i;
+    hexValue[(unsigned char) tolower(digit[i])] = i;
   }
+}
 
+//------------------------------------------------------------
+// Return the sum of the count bytes written as hex digits at p
+static int hexSum(const char *p, int count)
+{
+  int sum = 0;
+
+  for (int i=0; i<count; i++, p+=2)
+    sum += hexValue[(unsigned char) p[0]] * 16 + hexValue[(unsigned char) p[1]];
+  return sum;
+}
+
+//------------------------------------------------------------
+// Add the size bytes of data to the S-record being built
+static inline void putObj(int data, int size)
+{
+  for (int shift=(size-1)*8; shift>=0; shift-=8) {
+    int b = (data >> shift) & 0xFF;
+    objPtr[0] = hexByte[b][0];
+    objPtr[1] = hexByte[b][1];
+    objPtr += 2;
+    recordSum += b;
+  }
+}
+
+
+//------------------------------------------------------------
+// Output S0-record file header to recordFile
+static void headerObj()
+{
   /* Output S0-record file header
   S0 Record. The type of record is 'S0'. The address field is unused and will
   be filled with zeros (0x0000). The header information within the data field is
@@ -161,70 +303,164 @@ int initObj(char *name)
   //              S0 /0000 6 8 K P R O G       2 0 C R E A T E D   B Y   E A S Y 6 8 K
   strcpy(sRecord,"S021000036384B50524F47202020323043524541544544204259204541535936384B");
   byteCount =     0x21;
+  recordSum = hexSum(sRecord + 4, byteCount - 1);
   writeObj();
   byteCount = 0;
   lineFlag = false;
+}
+
+//------------------------------------------------------------
+// Open the S-record file and output its S0-record file header
+int initObj(char *name)
+{
+  objFile = fopen(name, "w+");
+  if (!objFile) {
+    sprintf(buffer,"Unable to create S-Record file");
+    return MILD_ERROR;
+  }
+  setvbuf(objFile, NULL, _IOFBF, OBJBUFSIZE);
+  initHex();
+  recordFile = objFile;
+  headerObj();
+
+  return NORMAL;
+}
+
+//------------------------------------------------------------
+// Open the binary file
+int initBin(char *name)
+{
+  binFile = fopen(name, "wb");
+  if (!binFile) {
+    sprintf(buffer,"Unable to create binary file");
+    return MILD_ERROR;
+  }
+  setvbuf(binFile, NULL, _IOFBF, OBJBUFSIZE);
+  return NORMAL;
+}
 
+//------------------------------------------------------------
+// Open the Intel HEX file
+int initIntel(char *name)
+{
+  hexFile = fopen(name, "w");
+  if (!hexFile) {
+    sprintf(buffer,"Unable to create Intel HEX file");
+    return MILD_ERROR;
+  }
+  setvbuf(hexFile, NULL, _IOFBF, OBJBUFSIZE);
+  initHex();
   return NORMAL;
 }
 
+//------------------------------------------------------------
+// Start an S-record of data at newAddr
+static void startObj(unsigned int newAddr)
+{
+  sRecord[0] = 'S';
+  if ((newAddr & 0xFFFF) == newAddr) {
+    sRecord[1] = '1';
+    byteCount = 3;
+  } else if ((newAddr & 0xFFFFFF) == newAddr) {
+    sRecord[1] = '2';
+    byteCount = 4;
+  } else {
+    sRecord[1] = '3';
+    byteCount = 5;
+  }
+  objPtr = sRecord + 4;
+  recordSum = 0;
+  putObj(newAddr, byteCount - 1);
+  objAddr = newAddr;
+  lineFlag = true;
+}
+
+//------------------------------------------------------------
+// Return the page of the image holding addr, adding it if needed
+static objPage *getPage(unsigned int addr)
+{
+  unsigned int num = addr >> OBJPAGEBITS;
+
+  if (lastPage && num == lastPageNum)
+    return lastPage;
+  objPage *&page = objImage[num];
+  if (!page) {
+    page = new objPage;
+    memset(page->used, 0, OBJPAGE);
+  }
+  lastPageNum = num;
+  lastPage = page;
+  return page;
+}
+
+//------------------------------------------------------------
+// Store count bytes at addr in the image. If period is 0 the bytes are
+// those at data, else byte i is data[i % period]. objOverlap is set if
+// a byte was already output.
+static void storeObj(unsigned int addr, const unsigned char *data, int period,
+                     int count)
+{
+  int phase = 0;
+
+  while (count > 0) {
+    objPage *page = getPage(addr);
+    int offset = addr & (OBJPAGE - 1);
+    int n = OBJPAGE - offset;           // bytes in this page
+    if (n > count)
+      n = count;
+    if (memchr(page->used + offset, 1, n))
+      objOverlap = true;
+    memset(page->used + offset, 1, n);
+    unsigned char *p = page->data + offset;
+    if (period == 0) {
+      memcpy(p, data, n);
+      data += n;
+    } else if (period == 1)
+      memset(p, data[0], n);
+    else
+      for (int i=0; i<n; i++) {
+        p[i] = data[phase];
+        if (++phase == period)
+          phase = 0;
+      }
+    addr += n;
+    count -= n;
+  }
+}
+
+//------------------------------------------------------------
+// Put the size bytes of data at p, most significant first
+static void bytesObj(unsigned char *p, int data, int size)
+{
+  for (int i=size-1; i>=0; i--, data >>= 8)
+    p[i] = data & 0xFF;
+}
+
 //------------------------------------------------------------
 int outputObj(int newAddr, int data, int size)
 {
+  unsigned char bytes[LONG_SIZE];
+
   try {
+    objDataAt = -1;
     if (offsetMode)       // don't write data if processing Offset directive
       return NORMAL;
 
-    // If the new data doesn't follow the previous data, or if the S-record
-    // would be too long, then write out this S-record and start a new one
-    if ((lineFlag && (newAddr != objAddr)) || (byteCount + size > SRECSIZE))
-    {
-      writeObj();
-      lineFlag = false;
-    }
-
-    // If no S-record is already being assembled, then start making one
-    if (!lineFlag) {
-      if ((newAddr & 0xFFFF) == newAddr) {
-	sprintf(sRecord, "S1  %04X", newAddr);
-	byteCount = 3;
-      }	else if ((newAddr & 0xFFFFFF) == newAddr) {
-	sprintf(sRecord, "S2  %06X", newAddr);
-	byteCount = 4;
-      }	else {
-	sprintf(sRecord, "S3  %08lX", newAddr);
-	byteCount = 5;
-      }
-      objPtr = sRecord + 4 + (byteCount-1)*2;
-      objAddr = newAddr;
-      lineFlag = true;
-    }
-
-    // Add the new data to the S-record
     switch (size) {
       case BYTE_SIZE :
-        data &= 0xFF;
-	sprintf(objPtr, "%02X", data);
-	byteCount++;
-	break;
       case WORD_SIZE :
-        data &= 0xFFFF;
-	sprintf(objPtr, "%04X", data);
-	byteCount += 2;
-	break;
       case LONG_SIZE :
-        sprintf(objPtr, "%08lX", data);
-	byteCount += 4;
+        bytesObj(bytes, data, size);
+        storeObj(newAddr, bytes, 0, size);
 	break;
       default :
         sprintf(buffer,"outputObj: INVALID SIZE CODE!\n");
 	return MILD_ERROR;
     }
-    objPtr += size*2;
-    objAddr += (int) size;
+    objDataAt = newAddr;
   }
   catch( ... ) {
-    sprintf(buffer, "ERROR: An exception occurred in routine 'initObj'. \n");
+    sprintf(buffer, "ERROR: An exception occurred in routine 'outputObj'. \n");
     printError(NULL, EXCEPTION, 0);
     return MILD_ERROR;
   }
@@ -232,31 +468,95 @@ int outputObj(int newAddr, int data, int size)
 }
 
 //------------------------------------------------------------
+// Output count copies of data of size starting at newAddr, as count
+// calls of outputObj() would
+int fillObj(int newAddr, int data, int size, int count)
+{
+  unsigned char bytes[LONG_SIZE];
+
+  try {
+    objDataAt = -1;
+    if (offsetMode || count <= 0)
+      return NORMAL;
+    if (size != BYTE_SIZE && size != WORD_SIZE && size != LONG_SIZE) {
+      sprintf(buffer,"fillObj: INVALID SIZE CODE!\n");
+      return MILD_ERROR;
+    }
+    bytesObj(bytes, data, size);
+    storeObj(newAddr, bytes, size, size * count);
+  }
+  catch( ... ) {
+    sprintf(buffer, "ERROR: An exception occurred in routine 'fillObj'. \n");
+    printError(NULL, EXCEPTION, 0);
+    return MILD_ERROR;
+  }
+  return NORMAL;
+}
+
+//------------------------------------------------------------
+// Output the count bytes at data starting at newAddr, as count calls
+// of outputObj() would
+int blockObj(int newAddr, const unsigned char *data, int count)
+{
+  try {
+    objDataAt = -1;
+    if (offsetMode || count <= 0)
+      return NORMAL;
+    storeObj(newAddr, data, 0, count);
+  }
+  catch( ... ) {
+    sprintf(buffer, "ERROR: An exception occurred in routine 'blockObj'. \n");
+    printError(NULL, EXCEPTION, 0);
+    return MILD_ERROR;
+  }
+  return NORMAL;
+}
+
+//------------------------------------------------------------
+// Replace the size bytes at addr, output earlier, with data
+void patchObj(int addr, int data, int size)
+{
+  unsigned char bytes[LONG_SIZE];
+
+  bytesObj(bytes, data, size);
+  for (int i=0; i<size; i++)
+    getPage(addr + i)->data[(addr + i) & (OBJPAGE - 1)] = bytes[i];
+}
+
+//------------------------------------------------------------
+// Remove all data from the image
+void clearObj()
+{
+  std::map<unsigned int, objPage *>::iterator it;
+
+  for (it = objImage.begin(); it != objImage.end(); ++it)
+    delete it->second;
+  objImage.clear();
+  lastPage = NULL;
+  objOverlap = false;
+}
+
+//------------------------------------------------------------
+// Write the S-record in sRecord. Its checksum is that of recordSum and
+// the record length.
 int writeObj()
 {
-  char recLen[3];
-  std::string str = "0x";
-  char* sRec = sRecord;
+  int checksum = ~(recordSum + byteCount) & 0xFF;
+  char *end = sRecord + 2 + byteCount*2;
 
   try {
     // Fill in the record length (including the checksum in the record length
-    sprintf(recLen, "%02X", byteCount);
-    sRec += 2;          // point to byte count location
-    strncpy(sRec, recLen, 2);
-
-    // Calculate checksum and add to record
-    checksum = 0;
-    for (int i=0; i<byteCount; i++) {
-      str = "0x";
-      str += *sRec++;
-      str += *sRec++;
-      checksum += (char) ((std::stoi(str) & 0xFF) & 0xFF);
-    }
-    sprintf(sRec, "%02X\n", (~checksum & 0xFF)); // put checksum in sRecord
+    sRecord[2] = hexByte[byteCount][0];
+    sRecord[3] = hexByte[byteCount][1];
+
+    // Add the checksum to the record
+    end[0] = hexByte[checksum][0];
+    end[1] = hexByte[checksum][1];
+    end[2] = '\n';
 
     // Output the S-record to the object file
-    fputs(sRecord, objFile);
-    if (ferror(objFile)) {
+    fwrite(sRecord, 1, end + 3 - sRecord, recordFile);
+    if (ferror(recordFile)) {
       sprintf(buffer,objErrorMsg);
       return MILD_ERROR;
     }
@@ -278,7 +578,7 @@ int writeObj()
 //   start and end contain addresses
 int writeMap(char* name, int start, int end)
 {
-  char data[6];
+  char data[7];
 
   try {
     sprintf(sRecord, "S0  %04X", 0);
@@ -303,6 +603,7 @@ int writeMap(char* name, int start, int end)
       objPtr += 2;
     }
     byteCount += 6;
+    recordSum = hexSum(sRecord + 4, byteCount - 1);
   }
   catch( ... ) {
     sprintf(buffer, "ERROR: An exception occurred in routine 'writeMap'. \n");
@@ -314,13 +615,286 @@ int writeMap(char* name, int start, int end)
 }
 
 //------------------------------------------------------------
-int finishObj()
+// Write out the S-record being built, if present
+static int flushObj()
+{
+  if (lineFlag) {
+    lineFlag = false;
+    return writeObj();
+  }
+  return NORMAL;
+}
+
+//------------------------------------------------------------
+// Write the count bytes at data, whose address is addr, into S-records.
+// The bytes continue the S-record being built if they follow its data
+// and fit.
+static void recordObj(unsigned int addr, const unsigned char *data, int count)
+{
+  int n;
+
+  if (lineFlag && addr != objAddr)
+    flushObj();
+  while (count > 0) {
+    if (lineFlag && byteCount >= srecSize)
+      flushObj();
+    if (!lineFlag)
+      startObj(addr);
+    n = srecSize - byteCount;           // bytes that fit
+    if (n > count)
+      n = count;
+    for (int i=0; i<n; i++)
+      putObj(data[i], BYTE_SIZE);
+    data += n;
+    byteCount += n;
+    objAddr += n;
+    addr += n;
+    count -= n;
+  }
+}
+
+//------------------------------------------------------------
+// Call record with each run of contiguous output bytes in the image, in
+// address order. A run that crosses pages is passed a page at a time.
+static void walkImage(void (*record)(unsigned int, const unsigned char *, int))
+{
+  std::map<unsigned int, objPage *>::iterator it;
+  const unsigned char *used, *end, *run;
+
+  for (it = objImage.begin(); it != objImage.end(); ++it) {
+    objPage *page = it->second;
+    unsigned int base = it->first << OBJPAGEBITS;
+    used = page->used;
+    end = used + OBJPAGE;
+    while (used < end) {
+      run = (const unsigned char *) memchr(used, 1, end - used);
+      if (!run)
+        break;
+      used = (const unsigned char *) memchr(run, 0, end - run);
+      if (!used)
+        used = end;
+      record(base + (run - page->used), page->data + (run - page->used),
+             used - run);
+    }
+  }
+}
+
+//------------------------------------------------------------
+// Write the image in S-records, each contiguous run of output bytes in
+// as few as fit, in address order
+static void writeImage()
+{
+  walkImage(recordObj);
+  flushObj();
+}
+
+//------------------------------------------------------------
+// Find the lowest and highest addresses output to the image. Returns
+// false if the image is empty.
+static bool imageRange(unsigned int *low, unsigned int *high)
+{
+  objPage *page;
+  int i;
+
+  if (objImage.empty())
+    return false;
+  page = objImage.begin()->second;
+  for (i=0; !page->used[i]; i++)
+    ;
+  *low = (objImage.begin()->first << OBJPAGEBITS) + i;
+  page = objImage.rbegin()->second;
+  for (i=OBJPAGE-1; !page->used[i]; i--)
+    ;
+  *high = (objImage.rbegin()->first << OBJPAGEBITS) + i;
+  return true;
+}
+
+//------------------------------------------------------------
+// Write binSize bytes of the image from binBase to the binary file, with
+// binFill in the bytes not output, and close it. Without -b and -z the
+// file holds the image from its lowest to its highest address.
+static int finishBin()
 {
+  std::map<unsigned int, objPage *>::iterator it;
+  unsigned char block[OBJPAGE];
+  unsigned int low, high, addr, size;
+  int offset, n;
 
   try {
-    // Write out the last real S-record, if present
-    if (lineFlag)
-      writeObj();
+    addr = binBase;
+    size = binSize;
+    if (imageRange(&low, &high)) {
+      if (!binBaseSet)
+        addr = low;
+      if (!binSizeSet)
+        size = (high >= addr) ? high - addr + 1 : 0;
+    } else if (!binSizeSet)
+      size = 0;
+
+    // A page at a time, the bytes not output are binFill
+    while (size > 0) {
+      offset = addr & (OBJPAGE - 1);
+      n = OBJPAGE - offset;
+      if ((unsigned int) n > size)
+        n = size;
+      it = objImage.find(addr >> OBJPAGEBITS);
+      if (it == objImage.end())
+        memset(block, binFill, n);
+      else
+        for (int i=0; i<n; i++)
+          block[i] = (it->second->used[offset + i]) ?
+                     it->second->data[offset + i] : binFill;
+      fwrite(block, 1, n, binFile);
+      addr += n;
+      size -= n;
+    }
+
+    if (ferror(binFile)) {
+      fclose(binFile);
+      sprintf(buffer, "Error writing to binary file\n");
+      return MILD_ERROR;
+    }
+    fclose(binFile);
+  }
+  catch( ... ) {
+    fclose(binFile);
+    sprintf(buffer, "ERROR: An exception occurred in routine 'finishBin'. \n");
+    printError(NULL, EXCEPTION, 0);
+    return MILD_ERROR;
+  }
+  return NORMAL;
+}
+
+//------------------------------------------------------------
+// Write an Intel HEX record of type holding the count bytes at data,
+// with the low 16 bits of addr as its address
+static void intelRecord(int type, unsigned int addr, const unsigned char *data,
+                        int count)
+{
+  char record[INTELSIZE*2 + 16], *p = record;
+  int sum = count + ((addr >> 8) & 0xFF) + (addr & 0xFF) + type;
+
+  *p++ = ':';
+  p[0] = hexByte[count][0];
+  p[1] = hexByte[count][1];
+  p[2] = hexByte[(addr >> 8) & 0xFF][0];
+  p[3] = hexByte[(addr >> 8) & 0xFF][1];
+  p[4] = hexByte[addr & 0xFF][0];
+  p[5] = hexByte[addr & 0xFF][1];
+  p[6] = hexByte[type][0];
+  p[7] = hexByte[type][1];
+  p += 8;
+  for (int i=0; i<count; i++, p+=2) {
+    p[0] = hexByte[data[i]][0];
+    p[1] = hexByte[data[i]][1];
+    sum += data[i];
+  }
+  sum = -sum & 0xFF;
+  p[0] = hexByte[sum][0];
+  p[1] = hexByte[sum][1];
+  p[2] = '\n';
+  fwrite(record, 1, p + 3 - record, hexFile);
+}
+
+//------------------------------------------------------------
+// Write the data record being built, if any
+static void flushIntel()
+{
+  unsigned char upper[2];
+
+  if (intelCount == 0)
+    return;
+  // An extended linear address record gives the upper 16 bits of the
+  // addresses of the data records that follow it
+  if (!intelUpperSet || (intelAddr >> 16) != intelUpper) {
+    intelUpper = intelAddr >> 16;
+    intelUpperSet = true;
+    upper[0] = intelUpper >> 8;
+    upper[1] = intelUpper & 0xFF;
+    intelRecord(4, 0, upper, 2);
+  }
+  intelRecord(0, intelAddr, intelData, intelCount);
+  intelCount = 0;
+}
+
+//------------------------------------------------------------
+// Write the count bytes at data, whose address is addr, into Intel HEX
+// data records. A record does not cross a 64K boundary.
+static void recordIntel(unsigned int addr, const unsigned char *data, int count)
+{
+  if (intelCount && addr != intelAddr + intelCount)
+    flushIntel();
+  while (count > 0) {
+    if (intelCount == INTELSIZE ||
+        (intelCount && ((intelAddr + intelCount) & 0xFFFF) == 0))
+      flushIntel();
+    if (intelCount == 0)
+      intelAddr = addr;
+    intelData[intelCount++] = *data++;
+    addr++;
+    count--;
+  }
+}
+
+//------------------------------------------------------------
+// Write the image and the start address to the Intel HEX file and
+// close it
+static int finishIntel()
+{
+  unsigned char start[4];
+
+  try {
+    intelCount = 0;
+    intelUpperSet = false;
+    walkImage(recordIntel);
+    flushIntel();
+
+    // Start linear address record, then end of file record
+    start[0] = (startAddress >> 24) & 0xFF;
+    start[1] = (startAddress >> 16) & 0xFF;
+    start[2] = (startAddress >> 8) & 0xFF;
+    start[3] = startAddress & 0xFF;
+    intelRecord(5, 0, start, 4);
+    intelRecord(1, 0, NULL, 0);
+
+    if (ferror(hexFile)) {
+      fclose(hexFile);
+      sprintf(buffer, "Error writing to Intel HEX file\n");
+      return MILD_ERROR;
+    }
+    fclose(hexFile);
+  }
+  catch( ... ) {
+    fclose(hexFile);
+    sprintf(buffer, "ERROR: An exception occurred in routine 'finishIntel'. \n");
+    printError(NULL, EXCEPTION, 0);
+    return MILD_ERROR;
+  }
+  return NORMAL;
+}
+
+//------------------------------------------------------------
+// Write the S8 record, with the starting address, to recordFile
+static void endObj()
+{
+  // S8 Record. The address field contains a 3-byte starting execution address.
+  // There is no data field.
+  sprintf(sRecord, "S8  %06X", startAddress);
+  byteCount = 4;
+  objPtr = sRecord + 4 + (byteCount-1)*2;
+  recordSum = hexSum(sRecord + 4, byteCount - 1);
+  writeObj();
+}
+
+//------------------------------------------------------------
+// Write the image, the memory map and the start address to the S-record
+// file and close it
+static int finishS68()
+{
+
+  try {
+    // Write out the image in S-records
+    writeImage();
 
     // Write S0 records for memory map
     if (mapROM) {
@@ -347,12 +921,7 @@ int finishObj()
     }
 
     // Write out a S8 record and close the file
-    // S8 Record. The address field contains a 3-byte starting execution address.
-    // There is no data field.
-    sprintf(sRecord, "S8  %06X", startAddress);
-    byteCount = 4;
-    objPtr = sRecord + 4 + (byteCount-1)*2;
-    writeObj();
+    endObj();
 
     if (ferror(objFile)) {
       sprintf(buffer,objErrorMsg);
@@ -363,10 +932,278 @@ int finishObj()
   }
   catch( ... ) {
     fclose(objFile);
-    sprintf(buffer, "ERROR: An exception occurred in routine 'finishObj'. \n");
+    sprintf(buffer, "ERROR: An exception occurred in routine 'finishS68'. \n");
+    printError(NULL, EXCEPTION, 0);
+    return MILD_ERROR;
+  }
+  return NORMAL;
+}
+
+//------------------------------------------------------------
+// Return the page of the previous image holding addr, adding it if needed
+static objPage *prevPage(unsigned int addr)
+{
+  objPage *&page = prevImage[addr >> OBJPAGEBITS];
+
+  if (!page) {
+    page = new objPage;
+    memset(page->used, 0, OBJPAGE);
+  }
+  return page;
+}
+
+//------------------------------------------------------------
+// Remove all data from the previous image
+static void clearPrev()
+{
+  std::map<unsigned int, objPage *>::iterator it;
+
+  for (it = prevImage.begin(); it != prevImage.end(); ++it)
+    delete it->second;
+  prevImage.clear();
+}
+
+//------------------------------------------------------------
+// Read the image of the previous build from the S-record file name. It
+// is read before the object files are opened, which may replace it.
+int loadDelta(char *name)
+{
+  char record[SREC_MAX*2 + 16];
+  FILE *file;
+  objPage *page;
+  unsigned int addr, num;
+  int count, addrSize, length, b;
+
+  try {
+    initHex();
+    file = fopen(name, "r");
+    if (!file) {
+      snprintf(buffer, sizeof(buffer),
+               "Unable to read previous S-Record file %s\n", name);
+      return MILD_ERROR;
+    }
+    while (fgets(record, sizeof(record), file)) {
+      if (record[0] != 'S' || record[1] < '1' || record[1] > '3')
+        continue;                       // S0, S5, S7, S8 or S9
+      addrSize = record[1] - '0' + 1;
+      length = strcspn(record, "\r\n");
+      count = hexSum(record + 2, 1);
+      for (b=2; b<length && hexValue[(unsigned char) record[b]] >= 0; b++)
+        ;
+      if (b != length || length != 4 + count*2 || count < addrSize + 1 ||
+          (hexSum(record + 2, count + 1) & 0xFF) != 0xFF) {
+        fclose(file);
+        clearPrev();
+        snprintf(buffer, sizeof(buffer),
+                 "Invalid S-record in previous file %s\n", name);
+        return MILD_ERROR;
+      }
+      addr = 0;
+      for (b=0; b<addrSize; b++)
+        addr = (addr << 8) | hexSum(record + 4 + b*2, 1);
+      page = NULL;
+      num = 0;
+      for (b=addrSize; b<count-1; b++, addr++) {
+        if (!page || (addr >> OBJPAGEBITS) != num) {
+          num = addr >> OBJPAGEBITS;
+          page = prevPage(addr);
+        }
+        page->data[addr & (OBJPAGE - 1)] = hexSum(record + 4 + b*2, 1);
+        page->used[addr & (OBJPAGE - 1)] = 1;
+      }
+    }
+    fclose(file);
+  }
+  catch( ... ) {
+    sprintf(buffer, "ERROR: An exception occurred in routine 'loadDelta'. \n");
     printError(NULL, EXCEPTION, 0);
     return MILD_ERROR;
   }
   return NORMAL;
 }
 
+//------------------------------------------------------------
+// Open the files for the changed S-records and binary patch ranges. A
+// name is NULL if that file is not wanted.
+int initDelta(char *recordName, char *patchName)
+{
+  if (recordName) {
+    deltaFile = fopen(recordName, "w");
+    if (!deltaFile) {
+      sprintf(buffer,"Unable to create delta S-Record file");
+      return MILD_ERROR;
+    }
+    setvbuf(deltaFile, NULL, _IOFBF, OBJBUFSIZE);
+  }
+  if (patchName) {
+    patchFile = fopen(patchName, "wb");
+    if (!patchFile) {
+      sprintf(buffer,"Unable to create binary patch file");
+      return MILD_ERROR;
+    }
+    setvbuf(patchFile, NULL, _IOFBF, OBJBUFSIZE);
+  }
+  return NORMAL;
+}
+
+//------------------------------------------------------------
+// Add the bytes of a run of the image that differ from the previous
+// image to deltaRanges. A change joins the range before it if no more
+// than DELTAGAP bytes, all output, lie between them.
+static void deltaRun(unsigned int addr, const unsigned char *data, int count)
+{
+  std::map<unsigned int, objPage *>::iterator it;
+  objPage *prev;
+  int offset = addr & (OBJPAGE - 1);
+
+  it = prevImage.find(addr >> OBJPAGEBITS);
+  prev = (it == prevImage.end()) ? NULL : it->second;
+  if (addr != deltaEnd)                 // bytes not output since the last run
+    deltaJoin = false;
+  for (int i=0; i<count; i++) {
+    if (prev && prev->used[offset + i] && prev->data[offset + i] == data[i])
+      continue;
+    if (deltaJoin && addr + i - deltaRanges.back().end <= DELTAGAP)
+      deltaRanges.back().end = addr + i + 1;
+    else {
+      deltaRange r = { addr + i, addr + i + 1 };
+      deltaRanges.push_back(r);
+    }
+    deltaJoin = true;
+  }
+  deltaEnd = addr + count;
+}
+
+//------------------------------------------------------------
+// Call record with the bytes of the image from start up to end, a page
+// at a time. All of them were output.
+static void imageBytes(unsigned int start, unsigned int end,
+                       void (*record)(unsigned int, const unsigned char *, int))
+{
+  int offset, n;
+
+  while (start != end) {
+    offset = start & (OBJPAGE - 1);
+    n = OBJPAGE - offset;
+    if ((unsigned int) n > end - start)
+      n = end - start;
+    record(start, objImage[start >> OBJPAGEBITS]->data + offset, n);
+    start += n;
+  }
+}
+
+//------------------------------------------------------------
+// Write a patch range of the count bytes at data, whose address is addr:
+// the address and the byte count, 4 bytes each with the most significant
+// first, then the bytes
+static void patchRun(unsigned int addr, const unsigned char *data, int count)
+{
+  unsigned char head[8];
+
+  if (!patchStarted) {
+    bytesObj(head, addr, LONG_SIZE);
+    bytesObj(head + 4, patchCount, LONG_SIZE);
+    fwrite(head, 1, 8, patchFile);
+    patchStarted = true;
+  }
+  fwrite(data, 1, count, patchFile);
+}
+
+//------------------------------------------------------------
+// Compare the image with the previous image. Writes the changed bytes
+// to the delta S-record file and the binary patch file, if open, and
+// prints the changed address ranges.
+static int finishDelta()
+{
+  std::map<unsigned int, objPage *>::iterator it, cur;
+  unsigned int changed = 0, removed = 0;
+  unsigned int i;
+
+  try {
+    deltaRanges.clear();
+    deltaJoin = false;
+    deltaEnd = 0;
+    walkImage(deltaRun);
+
+    if (deltaFile) {
+      recordFile = deltaFile;
+      headerObj();
+      for (i=0; i<deltaRanges.size(); i++)
+        imageBytes(deltaRanges[i].start, deltaRanges[i].end, recordObj);
+      flushObj();
+      endObj();
+      recordFile = objFile;
+    }
+    if (patchFile)
+      for (i=0; i<deltaRanges.size(); i++) {
+        patchCount = deltaRanges[i].end - deltaRanges[i].start;
+        patchStarted = false;
+        imageBytes(deltaRanges[i].start, deltaRanges[i].end, patchRun);
+      }
+
+    // Bytes of the previous image that are not output now
+    for (it = prevImage.begin(); it != prevImage.end(); ++it) {
+      cur = objImage.find(it->first);
+      for (int j=0; j<OBJPAGE; j++)
+        if (it->second->used[j] &&
+            (cur == objImage.end() || !cur->second->used[j]))
+          removed++;
+    }
+
+    for (i=0; i<deltaRanges.size(); i++)
+      changed += deltaRanges[i].end - deltaRanges[i].start;
+    printf("Delta against %s: %d changed range%s, %u byte%s\n", deltaName,
+           (int) deltaRanges.size(), (deltaRanges.size() == 1) ? "" : "s",
+           changed, (changed == 1) ? "" : "s");
+    for (i=0; i<deltaRanges.size(); i++) {
+      changed = deltaRanges[i].end - deltaRanges[i].start;
+      printf("  $%08X-$%08X  %u byte%s\n", deltaRanges[i].start,
+             deltaRanges[i].end - 1, changed, (changed == 1) ? "" : "s");
+    }
+    if (removed)
+      printf("  %u byte%s of the previous image no longer output\n", removed,
+             (removed == 1) ? "" : "s");
+  }
+  catch( ... ) {
+    sprintf(buffer, "ERROR: An exception occurred in routine 'finishDelta'. \n");
+    printError(NULL, EXCEPTION, 0);
+    return MILD_ERROR;
+  }
+
+  int status = NORMAL;
+  if (deltaFile) {
+    if (ferror(deltaFile))
+      status = MILD_ERROR;
+    fclose(deltaFile);
+  }
+  if (patchFile) {
+    if (ferror(patchFile))
+      status = MILD_ERROR;
+    fclose(patchFile);
+  }
+  if (status != NORMAL)
+    sprintf(buffer, "Error writing to delta file\n");
+  deltaFile = patchFile = NULL;
+  deltaRanges.clear();
+  clearPrev();
+  return status;
+}
+
+//------------------------------------------------------------
+// Write each object code file that was opened and free the image
+int finishObj()
+{
+  int status = NORMAL;
+
+  if (objFile && finishS68() != NORMAL)
+    status = MILD_ERROR;
+  if (binFile && finishBin() != NORMAL)
+    status = MILD_ERROR;
+  if (hexFile && finishIntel() != NORMAL)
+    status = MILD_ERROR;
+  if (deltaName && finishDelta() != NORMAL)
+    status = MILD_ERROR;
+  objFile = binFile = hexFile = NULL;
+  clearObj();
+  return status;
+}
@@ -50,53 +50,90 @@
 
 #include <stdio.h>
 #include <ctype.h>
+#include <vector>
 #include "asm.h"
 
 extern bool pass2;
 extern char buffer[256];  //ck used to form messages for display in windows
 extern char numBuf[20];
 extern int loc;
+extern int evalFix;             // fixup expression of last eval(), or -1
 
 //#define isTerm(c)   (isspace(c) || (c == ',') || c == '\0')
 //#define isRegNum(c) ((c >= '0') && (c <= '7'))
 
+static char *opParseOperand(char *p, opDescriptor *d, int *errorPtr);
+
+// Parse the operand at p. The source line is not modified; when the
+// addressing mode in ( ) contains spaces the operand is parsed from a copy
+// with the spaces removed and the returned pointer is mapped back to p.
 char *opParse(char *p, opDescriptor *d, int *errorPtr)
 {
-  char *n;
-  int parenCount;
+  char *sr, *end;
+  int parenCount, spaces, i;
 
   try {
     d->size = 0;
     // if addressing mode in ( )
     // remove spaces inside parenthesis       CK Oct-26-2008
     if (p[0] == '(' || p[1] == '(') {
-      char *sr = p;
-      char *ds = p;
-      parenCount=1;
-      *ds++ = *sr++;            // copy first char
+      sr = p + 1;               // skip first char
       if (*sr == '(')           // if second char is '('
-        *ds++ = *sr++;          // copy (
+        sr++;                   // skip (
+      parenCount=1;
+      spaces = 0;
       while (*sr && parenCount) {
         if (*sr == '(')
           parenCount++;
         else if (*sr == ')')
           parenCount--;
-        if (isspace(*sr))    // skip spaces
-          sr++;
-        else
-          *ds++ = *sr++;
+        if (isspace(*sr))       // count spaces
+          spaces++;
+        sr++;
       }
       if (!*sr && parenCount) {         // if no ')' found
         NEWERROR(*errorPtr, SYNTAX);
         return NULL;
       }
 
-      while( (*ds++ = *sr++) != 0);  // copy ')' and remaining text
+      if (spaces) {
+        std::string operand;
+        std::vector<int> offset;        // offset in p of each char of operand
+        for (i=0; p+i < sr; i++)
+          if (i == 0 || !isspace(p[i])) {
+            operand += p[i];
+            offset.push_back(i);
+          }
+        operand += sr;                  // remaining text
+        for (i=0; sr[i]; i++)
+          offset.push_back(sr - p + i);
+        offset.push_back(sr - p + i);
+        end = opParseOperand(&operand[0], d, errorPtr);
+        if (end == NULL)
+          return NULL;
+        return p + offset[end - &operand[0]];
+      }
     }
+    return opParseOperand(p, d, errorPtr);
+  }
+  catch( ... ) {
+    NEWERROR(*errorPtr, EXCEPTION);
+    sprintf(buffer, "ERROR: An exception occurred in routine 'opParse'. \n");
+    return NULL;
+  }
+}
 
+// Parse an operand that has no spaces inside ( )
+static char *opParseOperand(char *p, opDescriptor *d, int *errorPtr)
+{
+  char *n;
+
+  try {
+    d->fix = -1;
     // Check for immediate mode
     if (p[0] == '#') {
       p = eval(++p, &(d->data), &(d->backRef), errorPtr);
+      d->fix = evalFix;
       // If expression evaluates OK, then return
       if (*errorPtr < SEVERE) {
         if (isTerm(*p) || p[0]=='.') {
@@ -203,6 +240,7 @@ char *opParse(char *p, opDescriptor *d, int *errorPtr)
           p++;                  // skip (
           // evaluate displacement, p points to ','
           p = eval(p, &(d->data), &(d->backRef), errorPtr);
+          d->fix = evalFix;
         }
       }
 
@@ -255,6 +293,7 @@ char *opParse(char *p, opDescriptor *d, int *errorPtr)
         p++;                  // skip (
         // evaluate displacement, p points to ','
         p = eval(p, &(d->data), &(d->backRef), errorPtr);
+        d->fix = evalFix;
       }
 
       // Check for PC relative (PC) or (PC,Xi)
@@ -274,6 +313,7 @@ char *opParse(char *p, opDescriptor *d, int *errorPtr)
           d->mode = PCIndex;
           d->index = p[5] - '0';
           d->data = loc;            // CK 3-8-2018
+          d->fix = -1;
           if (p[4] == 'A')
             d->index += 8;
           if (p[6] == '.')
@@ -333,6 +373,7 @@ char *opParse(char *p, opDescriptor *d, int *errorPtr)
 
     // All other addressing modes start with a constant expression
     p = eval(p, &(d->data), &(d->backRef), errorPtr);
+    d->fix = evalFix;
     if (*errorPtr < SEVERE) {
       // Check for address register indirect with displacement
       if (p[0] == '(' &&
@@ -424,6 +465,9 @@ char *opParse(char *p, opDescriptor *d, int *errorPtr)
           p += 2;
           NEWERROR(*errorPtr, FORCING_SHORT); // forcing short addressing warning
         }
+        // a forward reference may be short with OPT RELAX
+        else if (!d->backRef && relaxed(RELAX_ABS, d->data))
+          d->mode = AbsShort;
         //(must be long if the symbol isn't defined or if the value is too big
         else if (!d->backRef || d->data > 32767 || d->data < -32768)
           d->mode = AbsLong;
@@ -26,13 +26,14 @@ int	processFile(void);
 
 int	assemble(char *, int *);
 
-int     createCode(char *, int *);
+int     createCode(char *, lineIR *, int *);
 
-int     assembleFile(char fileName[], char tempName[], std::string outputName, std::string workName);
+void    assembleInst(const instruction *, int, opDescriptor *, opDescriptor *, int *);
+
+int     assembleFile(char fileName[], std::string outputName, std::string workName);
 
 char    *fieldParse(char *p, opDescriptor *d, int *errorPtr);
 
-int	pickMask(int, flavor *, int *);
 
 int	move(int, int, opDescriptor *, opDescriptor *, int *);
 
@@ -88,6 +89,8 @@ int	link(int, int, opDescriptor *, opDescriptor *, int *);
 
 int	output(int, int);
 
+int	outputFill(int, int, int);
+
 int	effAddr(opDescriptor *);
 
 int	extWords(opDescriptor *, int, int *);
@@ -122,11 +125,17 @@ char	*eval(char *, int *, bool *, int *);
 
 char	*evalNumber(char *, int *, bool *, int *);
 
+void	clearExprCache(void);
+
 int	precedence(char);
 
 int	doOp(int, int, char, int *);
 
-char *instLookup(char *, instruction *(*), char *, int *);
+char *instLookup(char *, const instruction *(*), char *, int *);
+
+const instruction *instFind(const char *, int, unsigned int);
+
+const instDispatch *instDispatchFor(const instruction *);
 
 int	initList(char *);
 
@@ -142,8 +151,24 @@ int     listText(const char *text);
 
 int	listObj(int, int);
 
+int	listFill(int, int, int);
+
+long	listPos(void);
+
+void	listPatch(long, const char *, int);
+
+void	listCut(long);
+
 int	strcap(char *, char *);
 
+char	*lineReserve(int);
+
+sourceFile *loadSource(const char *);
+
+char	*nextLine(void);
+
+void	clearSources(void);
+
 char	*skipSpace(char *);
 
 int	setFlags(int, char *[], int *);
@@ -162,9 +187,21 @@ int     macro(int, char *, char *, int *);      //ck
 
 int     asmMacro(int, char *, char *, int *);   //ck
 
+int     rept(int, char *, char *, int *);
+
+int     irp(int, char *, char *, int *);
+
+int     irpc(int, char *, char *, int *);
+
+void	clearMacros(void);
+
 int     asmStructure(int, char *, char *, int *);  //ck
 
-int     tokenize(char* , char*, char*[], char*);  //ck
+int     tokenize(char* , int, tokenSpan[], int *);  //ck
+
+bool    tokenIs(tokenSpan, const char *);
+
+bool    tokenEqual(tokenSpan, tokenSpan);
 
 int     optCRE();                               //ck
 
@@ -172,8 +209,20 @@ char	*evalList(char *, unsigned short *, int *);
 
 int	initObj(char *);
 
+int	initBin(char *);
+
+int	initIntel(char *);
+
+int	loadDelta(char *);
+
+int	initDelta(char *, char *);
+
 int	outputObj(int, int, int);
 
+int	fillObj(int, int, int, int);
+
+int	blockObj(int, const unsigned char *, int);
+
 int	checkValue(int);
 
 int     finishList();
@@ -184,14 +233,40 @@ char	*opParse(char *, opDescriptor *, int *);
 
 symbolDef *lookup(char *, int, int *);
 
-int	hash(char *);
+unsigned int hash(const char *, int);
+
+void addMacro(symbolDef *);
+
+symbolDef *macroLookup(const char *, int, unsigned int);
 
 symbolDef *define(char *, int, bool, bool, int *);
 
+int ageSymbols();
+
 void clearSymbols();
 
+bool relaxed(int, int);
+
 int	writeObj(void);
 
+void	patchObj(int, int, int);
+
+void	clearObj(void);
+
+bool	fixStart(void);
+
+int	fixExpr(char *, int);
+
+int	outputFix(int, int, int, int, int);
+
+void	fixListed(int);
+
+void	fixListCut(int);
+
+bool	fixLine(void);
+
+bool	fixFinish(bool);
+
 int include(int, char *, char *, int *);
 
 int incbin(int, char *, char *, int *);
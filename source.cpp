@@ -0,0 +1,141 @@
+/***********************************************************************
+ *
+ *		SOURCE.CPP
+ *		Source File Cache for 68000 Assembler
+ *
+ *    Function: loadSource()
+ *		Returns the cached copy of a source file, reading the
+ *		file on first use. Files are cached by resolved path so
+ *		both passes and repeated INCLUDEs of a file read it from
+ *		memory.
+ *
+ *		nextLine()
+ *		Makes the next line of the current source file the
+ *		source line and its lineIR the current lineIR.
+ *
+ *		clearSources()
+ *		Frees the cached files.
+ *
+ ************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <map>
+
+#include "asm.h"
+
+extern char *line;		// Source line
+extern sourceFile *inSource;    // current source file
+extern int inLine;              // index of next line of inSource
+extern lineIR *curIR;           // lineIR of the source line
+extern char buffer[256];  //ck used to form messages for display in windows
+
+
+// The whole file is read with one fread. Its lines are then laid out in
+// text each followed by '\0', so a source line is used in place the same
+// way a line read by fgets was, including its '\n'. Every line is also
+// converted once by strcap() into folded at the same offset, and gets a
+// lineIR in which assemble() keeps what it learns from the text.
+
+std::map<std::string, sourceFile *> sourceCache;   // files by resolved path
+
+//--------------------------------------------------------
+// Return the cached source file name, reading it if it is not cached.
+// Returns NULL if the file cannot be read.
+sourceFile *loadSource(const char *name)
+{
+  FILE *fp;
+  char *resolved;
+  char *data;
+  long size;
+  int i, j, n;
+  sourceFile *src;
+
+  try {
+    resolved = realpath(name, NULL);
+    std::string key = (resolved) ? resolved : name;
+    free(resolved);
+    std::map<std::string, sourceFile *>::iterator it = sourceCache.find(key);
+    if (it != sourceCache.end())
+      return it->second;
+
+    fp = fopen(name, "rb");
+    if (!fp)
+      return NULL;
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (size < 0) {
+      fclose(fp);
+      return NULL;
+    }
+    data = (char *) malloc(size + 1);
+    size = fread(data, 1, size, fp);
+    fclose(fp);
+
+    n = 0;                                  // count lines
+    for (i=0; i<size; i++)
+      if (data[i] == '\n')
+        n++;
+    if (size > 0 && data[size-1] != '\n')   // if last line has no '\n'
+      n++;
+
+    src = (sourceFile *) malloc(sizeof(sourceFile));
+    src->text = (char *) malloc(size + n + 1);
+    src->folded = (char *) malloc(size + n + 1);
+    src->lineStart = (int *) malloc((n + 1) * sizeof(int));
+    src->ir = (lineIR *) calloc(n + 1, sizeof(lineIR));
+    src->lineCount = n;
+    n = 0;
+    j = 0;
+    for (i=0; i<size; i++) {
+      if (i == 0 || data[i-1] == '\n')      // if first character of line
+        src->lineStart[n++] = j;
+      src->text[j++] = data[i];
+      if (data[i] == '\n')
+        src->text[j++] = '\0';
+    }
+    src->lineStart[n] = j;
+    src->text[j] = '\0';
+    free(data);
+    for (i=0; i<n; i++)
+      strcap(src->folded + src->lineStart[i], src->text + src->lineStart[i]);
+
+    sourceCache[key] = src;
+    return src;
+  }
+  catch( ... ) {
+    sprintf(buffer, "ERROR: An exception occurred in routine 'loadSource'. \n");
+    printError(NULL, EXCEPTION, 0);
+    return NULL;
+  }
+}
+
+//--------------------------------------------------------
+// Make the next line of inSource the source line.
+// Returns line, or NULL at the end of the file.
+char *nextLine()
+{
+  if (inLine >= inSource->lineCount)
+    return NULL;
+  curIR = &inSource->ir[inLine];
+  line = inSource->text + inSource->lineStart[inLine++];
+  return line;
+}
+
+//--------------------------------------------------------
+// Free all cached source files
+void clearSources()
+{
+  std::map<std::string, sourceFile *>::iterator it;
+
+  for (it = sourceCache.begin(); it != sourceCache.end(); ++it) {
+    free(it->second->text);
+    free(it->second->folded);
+    free(it->second->lineStart);
+    free(it->second->ir);
+    free(it->second);
+  }
+  sourceCache.clear();
+}
@@ -11,19 +11,16 @@
           2023/12/16 Mouloud Agaoua
 
  ************************************************************************/
-#include <algorithm>
 #include <stack>
 #include <vector>
 #include <stdio.h>
 #include <ctype.h>
 #include <string.h>
 #include <iostream>
-#include <sstream>
-#include <iomanip>
 
 #include "asm.h"
 
-extern char line[256];		// Source line
+extern char *line;		// Source line
 extern bool listFlag;
 extern bool pass2;		// Flag set during second pass
 extern int loc;		// The assembler's location counter
@@ -39,21 +36,31 @@ extern FILE *listFile;		// Listing file
 extern bool skipList;           // true to skip listing line in ASSEMBLE.CPP
 extern int  macroNestLevel;     // used by macro processing
 extern char lineIdent[];        // "s" used to identify structure in listing
+extern char empty[];            // empty token
+extern int relaxCount;          // pass 1 repeats of OPT RELAX
+extern bool onePass;            // true while assembling in one pass
 
 
-// Define the uppercase function for use with transform
-std::string toUpperCase(const std::string& str) {
-  std::string result;
-  std::transform(str.begin(), str.end(), std::back_inserter(result), ::toupper);
-  return result;
+// Copy the first count tokens of span[] to null terminated strings in
+// tokens and point token[] at them. Missing tokens point to empty.
+// tokens must hold the tokenized line plus count terminators.
+static void tokenStrings(tokenSpan span[], int count, char *token[], char *tokens)
+{
+  for (int i=0; i<count; i++) {
+    if (span[i].start == empty)
+      token[i] = empty;
+    else {
+      token[i] = tokens;
+      memcpy(tokens, span[i].start, span[i].length);
+      tokens += span[i].length;
+      *tokens++ = '\0';
+    }
+  }
 }
 
-
 // prototypes
-std::string getBcc(std::string cc, int mode, int _or);
-void outCmpBcc(char *size, char *op1, char *cc, char *op2, char *op3,
-                    std::string label, int &error);
-void assembleStc(char* line);
+const char *getBcc(const char *cc, int mode, int _or);
+void outCmpBcc(char *token[], char *last, unsigned int label, int &error);
 
 const unsigned int stcMask  = 0xF0000000;
 const unsigned int stcMaskI = 0x00000000;
@@ -76,15 +83,12 @@ const int IM_EA_OR = 4;
 const int BCC_COUNT = 16;
 const int LAST_TOKEN = 11;      // highest token possible of structure
 
-// Global variables
-std::string stcLabel;
-
 // Make a stack using a vector containers
 std::stack<int,std::vector<int> > stcStack;
 // Make a stack for saving dbloop register number
 std::stack<char, std::vector<char> > dbStack;
 // Make a stack for saving FOR arguments
-std::stack<std::string, std::vector<std::string> > forStack;
+std::stack<forLoop, std::vector<forLoop> > forStack;
 
 // This table contains the branch condition codes to use for the different
 // conditional expressions.
@@ -116,17 +120,214 @@ const char* BccCodes[BCC_COUNT][5] = {
 
 //-------------------------------------------------------
 // returns a branch instruction
- 
+
 // or is 1 on ea <cc> ea OR, 0 otherwise
-std::string getBcc(std::string cc, int mode, int _or) {
-  cc = toUpperCase(cc);
+const char *getBcc(const char *cc, int mode, int _or) {
   for (int i=0; i<BCC_COUNT; i++) {
-    if (cc == BccCodes[i][0])
+    if (!strcasecmp(cc, BccCodes[i][0]))
       return BccCodes[i][mode + _or];
   }
   return "B??";
 }
 
+//-------------------------------------------------------
+// The code of a structured statement is assembled from what
+// asmStructure() already knows instead of from text. The instruction is
+// found by its mnemonic, the operands of the statement are parsed and a
+// label operand is looked up. The text of the line is only formed for
+// the listing, where it reads as
+//    \t<mnemonic><size><source>[,<dest>]
+//    _nnnnnnnn
+
+// An operand of structured code: text of the statement, or the label
+// _nnnnnnnn when text is NULL
+typedef struct {
+  const char *text;
+  unsigned int label;
+  const char *format;           // format of the label in the listing
+} stcOperand;
+
+static stcOperand textOp(const char *text)
+{
+  stcOperand op = { text, 0, NULL };
+  return op;
+}
+
+static stcOperand labelOp(unsigned int label)
+{
+  stcOperand op = { NULL, label, "_%08X" };
+  return op;
+}
+
+// Return the instruction mnemonic, or NULL if there is none
+static const instruction *findInst(const char *mnemonic)
+{
+  unsigned int h = FNV_BASIS;
+  int i;
+
+  for (i=0; mnemonic[i]; i++)
+    h = (h ^ (unsigned char) mnemonic[i]) * FNV_PRIME;
+  return instFind(mnemonic, i, h);
+}
+
+// Return the size code of a size as listed, ".B\t" ... ".S\t" or "\t"
+static int stcSize(const char *size)
+{
+  if (size[0] != '.')
+    return 0;
+  switch (size[1]) {
+    case 'B': return BYTE_SIZE;
+    case 'W': return WORD_SIZE;
+    case 'L': return LONG_SIZE;
+    default:  return SHORT_SIZE;
+  }
+}
+
+// Parse operand op into d, as opParse() would parse the label
+static bool stcParse(const stcOperand *op, opDescriptor *d, int *errorPtr)
+{
+  char name[16];
+  symbolDef *symbol;
+  int status = OK;
+  char *p;
+
+  if (op->text) {
+    p = opParse((char *) op->text, d, errorPtr);
+    if (!p || *errorPtr > SEVERE)
+      return false;
+    if (*p) {                   // if the token is more than an operand
+      NEWERROR(*errorPtr, SYNTAX);
+      return false;
+    }
+    return true;
+  }
+  snprintf(name, sizeof(name), "_%08X", op->label);
+  symbol = lookup(name, false, &status);
+  d->size = 0;
+  d->data = 0;
+  d->backRef = true;
+  d->fix = -1;
+  if (status == OK) {
+    d->data = symbol->value;
+    if (pass2)
+      d->backRef = (symbol->flags & BACKREF);
+  } else if (onePass) {         // label later in one pass assembly
+    d->fix = fixExpr(name, strlen(name));
+    d->backRef = false;
+  } else {
+    NEWERROR(*errorPtr, (pass2) ? UNDEFINED : INCOMPLETE);
+    if (symbol && relaxCount)   // estimate from previous pass 1
+      d->data = symbol->value;
+    d->backRef = false;
+  }
+  if (!d->backRef && relaxed(RELAX_ABS, d->data))
+    d->mode = AbsShort;
+  else if (!d->backRef || d->data > 32767 || d->data < -32768)
+    d->mode = AbsLong;
+  else
+    d->mode = AbsShort;
+  return true;
+}
+
+// Append the text of operand op to text
+static void stcText(std::string &text, const stcOperand *op)
+{
+  char name[16];
+
+  if (op->text)
+    text += op->text;
+  else {
+    snprintf(name, sizeof(name), op->format, op->label);
+    text += name;
+  }
+}
+
+// Start a line of structured code. Tags the line for the listing and
+// returns where the tag is.
+static int stcBegin()
+{
+  int i=0;
+  while(lineIdent[i] && i<MACRO_NEST_LIMIT)
+    i++;
+  lineIdent[i]='s';     // line identifier for listing
+  lineIdent[i+1]='\0';
+  if (!SEXflag)
+    skipList = true;
+  else
+    if (!(macroNestLevel > 0 && skipList == true)) // if not called from macro with listing off
+      skipList = false;
+  if (pass2 && listFlag)
+    listLoc();
+  return i;
+}
+
+// Return true if a line of structured code with error is listed
+static bool stcListed(int error)
+{
+  return pass2 && ((listFlag && !skipList) || error > WARNING);
+}
+
+// End a line of structured code started by stcBegin(), listing text if
+// it is not NULL, as assemble() does
+static void stcEnd(int i, const std::string *text, int error)
+{
+  if (pass2) {
+    if (error > MINOR)
+      errorCount++;
+    else if (error > WARNING)
+      warningCount++;
+    printError(listFile, error, lineNum);
+    if (text)
+      listLine((char *) text->c_str(), lineIdent);
+  }
+  lineIdent[i]='\0';
+}
+
+// Assemble the instruction mnemonic with size and operands source and
+// dest. dest is NULL for an instruction with one operand.
+static void stcCode(const char *mnemonic, const char *size,
+                    const stcOperand *source, const stcOperand *dest)
+{
+  const instruction *inst;
+  opDescriptor src, dst;
+  std::string text;
+  int error = OK;
+  int i = stcBegin();
+
+  inst = findInst(mnemonic);
+  if (!inst)                    // B?? from an unknown <cc>
+    NEWERROR(error, SYNTAX);
+  else if (stcParse(source, &src, &error) &&
+           (!dest || stcParse(dest, &dst, &error)))
+    assembleInst(inst, stcSize(size), &src, (dest) ? &dst : NULL, &error);
+
+  if (stcListed(error)) {
+    text = (std::string) "\t" + mnemonic + size;
+    stcText(text, source);
+    if (dest) {
+      text += ",";
+      stcText(text, dest);
+    }
+    text += "\n";
+  }
+  stcEnd(i, (stcListed(error)) ? &text : NULL, error);
+}
+
+// Define the label _nnnnnnnn, listed followed by end
+static void stcDefine(unsigned int label, const char *end)
+{
+  char name[16];
+  std::string text;
+  int error = OK;
+  int i = stcBegin();
+
+  snprintf(name, sizeof(name), "_%08X", label);
+  define(name, loc, pass2, true, &error);
+  if (stcListed(error))
+    text = (std::string) name + end;
+  stcEnd(i, (stcListed(error)) ? &text : NULL, error);
+}
+
 //-------------------------------------------------------
 // output a CMP and Branch to perform the specified expression
 // Pre: the code is in all caps
@@ -145,28 +346,27 @@ std::string getBcc(std::string cc, int mode, int _or) {
 //    .B   <cc>   AND   .B    D0   <cc>   D1   THEN
 //    .B    D0   <cc>   D1    AND   .B    D2   <cc>   D3   THEN
 
-//void outCmpBcc( char *size, char *op1, char *cc, char *op2, char *op3, char *last, std::string label, int &error) {
-void outCmpBcc( char *token[], char *last, std::string label, int &error) {
+void outCmpBcc( char *token[], char *last, unsigned int label, int &error) {
 
-  std::string stcLine, stcCmp, extent;
+  const char *size, *extent;
   int _or=0, n=0;
 
   try {
     error = OK;
     if (token[n][0] == '.') {
       if (token[n][1] == 'B')
-        stcCmp = "\tCMP.B\t";
+        size = ".B\t";
       else if (token[n][1] == 'W')
-        stcCmp = "\tCMP.W\t";
+        size = ".W\t";
       else if (token[n][1] == 'L')
-        stcCmp = "\tCMP.L\t";
+        size = ".L\t";
       else {
         error = SYNTAX;
         return;
       }
       n++;                        // token[n] at 1
     } else
-      stcCmp = "\tCMP.W\t";
+      size = ".W\t";
 
     // determine size of extent if present
     if (last[0] == '.') {
@@ -186,39 +386,31 @@ void outCmpBcc( char *token[], char *last, std::string label, int &error) {
       extent = ".S\t";            // first branch with OR logic is always short
     }
 
+    stcOperand op1 = textOp(token[n]);
+    stcOperand op2 = textOp(token[n+2]);
+    stcOperand target = labelOp(label);
     if (token[n][0] == '<') {     // IF <cc> THEN
-      stcLine = "\t" + getBcc(token[n],IF_CC,_or) + extent + label + "\n";
-      assembleStc(stcLine.data());
+      stcCode(getBcc(token[n],IF_CC,_or), extent, &target, NULL);
     }else if (token[n][0] == '#') {                    // #nn <cc> ea
-      stcLine = stcCmp + (std::string)token[n] + "," + token[n+2] + "\n";
-      assembleStc(stcLine.data());
-      stcLine = "\t" + getBcc(token[n+1],IM_EA,_or) + extent + label + "\n";
-      assembleStc(stcLine.data());
+      stcCode("CMP", size, &op1, &op2);
+      stcCode(getBcc(token[n+1],IM_EA,_or), extent, &target, NULL);
     }else if (token[n+2][0] == '#') {                    // ea <cc> #nn
-      stcLine = stcCmp + (std::string)token[n+2] + "," + (std::string)token[n] + "\n";
-      assembleStc(stcLine.data());
-      stcLine = "\t" + getBcc(token[n+1],EA_IM,_or) + extent + label + "\n";
-      assembleStc(stcLine.data());
+      stcCode("CMP", size, &op2, &op1);
+      stcCode(getBcc(token[n+1],EA_IM,_or), extent, &target, NULL);
     // Rn <cc> ea
     }else if ((token[n][0]=='A' || token[n][0]=='D') &&
                isRegNum(token[n][1])) {
-      stcLine = stcCmp + (std::string)token[n+2] + "," + (std::string)token[n] + "\n";
-      assembleStc(stcLine.data());
-      stcLine = "\t" + getBcc(token[n+1],RN_EA,_or) + extent + label + "\n";
-      assembleStc(stcLine.data());
+      stcCode("CMP", size, &op2, &op1);
+      stcCode(getBcc(token[n+1],RN_EA,_or), extent, &target, NULL);
     // ea <cc> Rn
     }else if ((token[n+2][0]=='A' || token[n+2][0]=='D') &&
                isRegNum(token[n+2][1])) {
-      stcLine = stcCmp + (std::string)token[n] + "," + (std::string)token[n+2] + "\n";
-      assembleStc(stcLine.data());
-      stcLine = "\t" + getBcc(token[n+1],EA_RN,_or) + extent + label + "\n";
-      assembleStc(stcLine.data());
+      stcCode("CMP", size, &op1, &op2);
+      stcCode(getBcc(token[n+1],EA_RN,_or), extent, &target, NULL);
     // (An)+ <cc> (An)+  also supports (SP)+ (MUST BE LAST IN IF-ELSE CHAIN)
     }else if ((token[n][0]=='(' && token[n][3]==')' && token[n][4]=='+')) {
-      stcLine = stcCmp + (std::string)token[n] + "," + (std::string)token[n+2] + "\n";
-      assembleStc(stcLine.data());
-      stcLine = "\t" + getBcc(token[n+1],RN_EA,_or) + extent + label + "\n";
-      assembleStc(stcLine.data());
+      stcCode("CMP", size, &op1, &op2);
+      stcCode(getBcc(token[n+1],RN_EA,_or), extent, &target, NULL);
     }else{
       error = SYNTAX;
     }
@@ -289,22 +481,21 @@ int asmStructure(int size, char *label, char *arg, int *errorPtr)
 {
   try {
 
+    tokenSpan span[256];          // tokens of line
     char *token[256];             // pointers to tokens
-    char tokens[512];             // place tokens here
-    char capLine[256];
+    std::vector<char> tokens;     // place tokens here
+    std::vector<char> capLine;
     char tokenEnd[10];            // last token of structure goes here
-    std::string stcLabel, stcLabel2, stcLine, sizeStr, extent;
-    symbolDef *symbol;
+    const char *extent, *sizeStr;
     int error;
-    int value;
-    bool backRef;
     int n = 2;                    // token index
     int i;
 
     if (*label)                           // if label
       define(label, loc, pass2, true, errorPtr); // define label
 
-    strcap(capLine, line);                // capitalize line
+    capLine.resize(strlen(line) + 1);
+    strcap(capLine.data(), line);         // capitalize line
     error = OK;
     if (pass2 && listFlag) {
       if (!(macroNestLevel > 0 && skipList == true)) // if not called from macro with listing off
@@ -316,23 +507,18 @@ int asmStructure(int size, char *label, char *arg, int *errorPtr)
           listLine(line, "\0");
       }
     }
-    std::string temptext =  ". \t\n";
-    tokenize(capLine,temptext.data() , token, tokens);  	// tokenize statement
+    tokenize(capLine.data(), DOT_DELIMS, span, NULL);  	// tokenize statement
+    tokens.resize(capLine.size() + LAST_TOKEN + 8);
+    tokenStrings(span, LAST_TOKEN + 8, token, tokens.data());
 
     if (token[n][0] == '.')
       n = 3;
 
     // -------------------- IF --------------------
     // IF[.B|.W|.L] op1 <cc> op2 [OR/AND[.B|.W|.L]  op3 <cc> op4] THEN
-    if (!(strcasecmp(token[1], "IF"))) {     
-      char buffer[9]; // 8 digits + null terminator
-      snprintf(buffer, 9, "%08X", stcLabelI);
-      std::string stcLabel = "_" + std::string(buffer);
-
-      
-       // IF ?
-      
-  
+    if (!(strcasecmp(token[1], "IF"))) {
+      unsigned int ifLabel = stcLabelI;
+
       tokenEnd[0] = '\0';
       for (i=3; i<=LAST_TOKEN; i++) {
         if (!(strcmp(token[i], "THEN"))) {    // find THEN
@@ -345,37 +531,27 @@ int asmStructure(int size, char *label, char *arg, int *errorPtr)
         NEWERROR(*errorPtr, error);
       }
       //           .B/W/L       op1       <cc>       op2   THEN/OR/AND  THEN.?   label
-      outCmpBcc(&token[2], tokenEnd, stcLabel, error);
+      outCmpBcc(&token[2], tokenEnd, ifLabel, error);
       NEWERROR(*errorPtr, error);
       if (!(strcmp(token[n+1], "OR"))) {    // IF <cc> OR
-        stcLabel2 = stcLabel;
         stcLabelI++;
-        char buffer[9]; // 8 digits + null terminator
-        snprintf(buffer, 9, "%08X", stcLabelI);
-        std::string stcLabel = "_" + std::string(buffer);
         //           .B/W/L       op3      <cc>      op4       THEN      THEN.?    label
-        outCmpBcc(&token[n+2], tokenEnd, stcLabel, error);
+        outCmpBcc(&token[n+2], tokenEnd, stcLabelI, error);
         NEWERROR(*errorPtr, error);
-        stcLine = stcLabel2 + "\n";
-        assembleStc(stcLine.data());
+        stcDefine(ifLabel, "\n");
       } else if (!(strcmp(token[n+3], "OR"))) { // IF ea <cc> ea OR
-        stcLabel2 = stcLabel;
         stcLabelI++;
-        char buffer[9]; // 8 digits + null terminator
-        snprintf(buffer, 9, "%08X", stcLabelI);
-        std::string stcLabel = "_" + std::string(buffer);
         //           .B/W/L       op3      <cc>      op4       THEN      THEN.?    label
-        outCmpBcc(&token[n+4], tokenEnd, stcLabel, error);
+        outCmpBcc(&token[n+4], tokenEnd, stcLabelI, error);
         NEWERROR(*errorPtr, error);
-        stcLine = stcLabel2 + "\n";
-        assembleStc(stcLine.data());
+        stcDefine(ifLabel, "\n");
       } else if (!(strcmp(token[n+1], "AND"))) { // IF <cc> AND
         //            .B/W/L       op3       <cc>      op4       THEN     THEN.?    label
-        outCmpBcc(&token[n+2], tokenEnd, stcLabel, error);
+        outCmpBcc(&token[n+2], tokenEnd, ifLabel, error);
         NEWERROR(*errorPtr, error);
       } else if (!(strcmp(token[n+3], "AND"))) { // IF ea <cc> ea AND
         //            .B/W/L       op3       <cc>      op4       THEN     THEN.?    label
-        outCmpBcc(&token[n+4], tokenEnd, stcLabel, error);
+        outCmpBcc(&token[n+4], tokenEnd, ifLabel, error);
         NEWERROR(*errorPtr, error);
       }
 
@@ -397,25 +573,19 @@ int asmStructure(int size, char *label, char *arg, int *errorPtr)
         else if (token[2][1] == 'L')
           extent = ".L\t";
         else {
+          extent = "";
           NEWERROR(*errorPtr, SYNTAX);
         }
       } else {
         extent = "\t";
       }
 
-      char buffer[9]; // 8 digits + null terminator
-      snprintf(buffer, 9, "%08X", stcLabelI);
-      std::string stcLabel = "_" + std::string(buffer);
-      stcLine = "\tBRA" + extent + stcLabel + "\n";
-      assembleStc(stcLine.data());
+      stcOperand endiLabel = labelOp(stcLabelI);
+      stcCode("BRA", extent, &endiLabel, NULL);
       stcStack.push(stcLabelI);
       stcLabelI++;
 
-      snprintf(buffer, 9, "%08X", elseLbl);
-      stcLine = "_" + std::string(buffer) + "\n";
-
-    
-      assembleStc(stcLine.data());
+      stcDefine(elseLbl, "\n");
       skipList = true;                        // don't display this line in ASSEMBLE.CPP
     }
 
@@ -425,10 +595,7 @@ int asmStructure(int size, char *label, char *arg, int *errorPtr)
       stcStack.pop();
       if ((endiLbl & stcMask) != stcMaskI)        // if label is not from an IF
         NEWERROR(*errorPtr, NO_IF);
-      char buffer[9]; // 8 digits + null terminator
-      snprintf(buffer, 9, "%08X", endiLbl);
-      std::string stcLine = "_" + std::string(buffer) + "\n";
-      assembleStc(stcLine.data());
+      stcDefine(endiLbl, "\n");
       skipList = true;                        // don't display this line in ASSEMBLE.CPP
     }
 
@@ -437,17 +604,11 @@ int asmStructure(int size, char *label, char *arg, int *errorPtr)
     // WHILE <T> D0 create infinite loop
     if (!(strcmp(token[1], "WHILE"))) {          // WHILE
 
-      char buffer[9]; // 8 digits + null terminator
-      snprintf(buffer, 9, "%08X", stcLabelW);
-      stcLabel = "_" + std::string(buffer);
-
-      stcLine = stcLabel + "\n";
-      assembleStc(stcLine.data());
+      stcDefine(stcLabelW, "\n");
       stcStack.push(stcLabelW);
       stcLabelW++;
 
-      snprintf(buffer, 9, "%08X", stcLabelW);
-      stcLabel = "_" + std::string(buffer);
+      unsigned int whileLabel = stcLabelW;
 
       tokenEnd[0] = '\0';
       for (i=3; i<=LAST_TOKEN; i++) {
@@ -460,37 +621,27 @@ int asmStructure(int size, char *label, char *arg, int *errorPtr)
         NEWERROR(*errorPtr, DO_EXPECTED);
       if ((strcmp(token[n], "<T>"))) {       // if not infinite loop <T>
         //            .B/W/L      op1       <cc>       op2   DO/OR/AND    DO.?     label
-        outCmpBcc(&token[2], tokenEnd, stcLabel, error);
+        outCmpBcc(&token[2], tokenEnd, whileLabel, error);
         NEWERROR(*errorPtr, error);
         if (!(strcmp(token[n+1], "OR"))) { // WHILE <cc> OR
-          stcLabel2 = stcLabel;
           stcLabelW++;
-          char buffer[9]; // 8 digits + null terminator
-          snprintf(buffer, 9, "%08X", stcLabelW);
-          std::string stcLabel = "_" + std::string(buffer);
           //           .B/W/L        op3      <cc>      op4       DO       DO.?      label
-          outCmpBcc(&token[n+2], tokenEnd, stcLabel, error);
+          outCmpBcc(&token[n+2], tokenEnd, stcLabelW, error);
           NEWERROR(*errorPtr, error);
-          stcLine = stcLabel2 + "\n";
-          assembleStc(stcLine.data());
+          stcDefine(whileLabel, "\n");
         } else if (!(strcmp(token[n+3], "OR"))) { // WHILE ea <cc> ea OR
-          stcLabel2 = stcLabel;
           stcLabelW++;
-          char buffer[9]; // 8 digits + null terminator
-          snprintf(buffer, 9, "%08X", stcLabelW);
-          std::string stcLabel = "_" + std::string(buffer);
           //           .B/W/L        op3      <cc>      op4       DO       DO.?      label
-          outCmpBcc(&token[n+4], tokenEnd, stcLabel, error);
+          outCmpBcc(&token[n+4], tokenEnd, stcLabelW, error);
           NEWERROR(*errorPtr, error);
-          stcLine = stcLabel2 + "\n";
-          assembleStc(stcLine.data());
+          stcDefine(whileLabel, "\n");
         } else if (!(strcmp(token[n+1], "AND"))) { // WHILE <cc> AND
           //           .B/W/L       op3       <cc>      op4       DO       DO.?      label
-          outCmpBcc(&token[n+2], tokenEnd, stcLabel, error);
+          outCmpBcc(&token[n+2], tokenEnd, whileLabel, error);
           NEWERROR(*errorPtr, error);
         } else if (!(strcmp(token[n+3], "AND"))) { // WHILE ea <cc> ea AND
           //           .B/W/L       op3       <cc>      op4       DO       DO.?      label
-          outCmpBcc(&token[n+4], tokenEnd, stcLabel, error);
+          outCmpBcc(&token[n+4], tokenEnd, whileLabel, error);
           NEWERROR(*errorPtr, error);
         }
       }
@@ -509,28 +660,16 @@ int asmStructure(int size, char *label, char *arg, int *errorPtr)
       unsigned int whileLbl = stcStack.top();
       stcStack.pop();
 
-      char buffer[9]; // 8 digits + null terminator
-      snprintf(buffer, 9, "%08X", whileLbl);
-      std::string stcLine = "\tBRA\t_" + std::string(buffer) + "\n";
-      assembleStc(stcLine.data());
-
-      snprintf(buffer, 9, "%08X", endwLbl);
-      stcLine = "_" + std::string(buffer) + "\n";
-
-      
-      assembleStc(stcLine.data());
+      stcOperand whileLabel = labelOp(whileLbl);
+      stcCode("BRA", "\t", &whileLabel, NULL);
+      stcDefine(endwLbl, "\n");
       skipList = true;                        // don't display this line in ASSEMBLE.CPP
     }
 
     // -------------------- REPEAT --------------------
     if (!(strcmp(token[1], "REPEAT"))) {
 
-      char buffer[9]; // 8 digits + null terminator
-      snprintf(buffer, 9, "%08X", stcLabelR);
-      std::string stcLabel = "_" + std::string(buffer) + "\n";
-
-      stcLine = stcLabel + "\n";
-      assembleStc(stcLine.data());
+      stcDefine(stcLabelR, "\n\n");
       stcStack.push(stcLabelR);
       stcLabelR++;
       skipList = true;                        // don't display this line in ASSEMBLE.CPP
@@ -544,17 +683,6 @@ int asmStructure(int size, char *label, char *arg, int *errorPtr)
       if ((untilLbl & stcMask) != stcMaskR)       // if label is not from a REPEAT
         NEWERROR(*errorPtr, NO_REPEAT);
 
-        
-      char buffer[9]; // 8 digits + null terminator
-      snprintf(buffer, 9, "%08X", untilLbl);
-      std::string stcLabel2 = "_" + std::string(buffer);
-
-
-
-      snprintf(buffer, 9, "%08X", stcLabelR);
-      stcLabel = "_" + std::string(buffer);
-      
-
       tokenEnd[0] = '\0';
       for (i=3; i<=LAST_TOKEN; i++) {
         if (!(strcmp(token[i], "DO"))) {     // if DO
@@ -566,37 +694,35 @@ int asmStructure(int size, char *label, char *arg, int *errorPtr)
         NEWERROR(*errorPtr, DO_EXPECTED);
       if (!(strcmp(token[n+1], "OR"))) {      // UNTIL <cc> OR
         //           .B/W/L       op1       <cc>       op2   DO/OR/AND    DO.?     label
-        outCmpBcc(&token[2], tokenEnd, stcLabel, error);
+        outCmpBcc(&token[2], tokenEnd, stcLabelR, error);
         NEWERROR(*errorPtr, error);
         //           .B/W/L       op3      <cc>      op4       DO         DO.?     label
-        outCmpBcc(&token[n+2], tokenEnd, stcLabel2, error);
-        stcLine = stcLabel + "\n";                // output label for first OR branch
-        assembleStc(stcLine.data());
+        outCmpBcc(&token[n+2], tokenEnd, untilLbl, error);
+        stcDefine(stcLabelR, "\n");               // output label for first OR branch
         stcLabelR++;
         NEWERROR(*errorPtr, error);
 
       } else if (!(strcmp(token[n+3], "OR"))) {      // UNTIL ea <cc> ea OR
         //           .B/W/L       op1       <cc>       op2   DO/OR/AND    DO.?     label
-        outCmpBcc(&token[2], tokenEnd, stcLabel, error);
+        outCmpBcc(&token[2], tokenEnd, stcLabelR, error);
         NEWERROR(*errorPtr, error);
         //           .B/W/L       op3      <cc>      op4       DO         DO.?     label
-        outCmpBcc(&token[n+4], tokenEnd, stcLabel2, error);
-        stcLine = stcLabel + "\n";                // output label for first OR branch
-        assembleStc(stcLine.data());
+        outCmpBcc(&token[n+4], tokenEnd, untilLbl, error);
+        stcDefine(stcLabelR, "\n");               // output label for first OR branch
         stcLabelR++;
         NEWERROR(*errorPtr, error);
 
       } else {
         //           .B/W/L       op1       <cc>       op2   DO/OR/AND    DO.?     label
-        outCmpBcc(&token[2], tokenEnd, stcLabel2, error);
+        outCmpBcc(&token[2], tokenEnd, untilLbl, error);
         NEWERROR(*errorPtr, error);
         if (!(strcmp(token[n+1], "AND"))) {   // UNTIL <cc> AND
           //           .B/W/L       op3      <cc>      op4       DO         DO.?     label
-          outCmpBcc(&token[n+2], tokenEnd, stcLabel2, error);
+          outCmpBcc(&token[n+2], tokenEnd, untilLbl, error);
           NEWERROR(*errorPtr, error);
         } else if (!(strcmp(token[n+3], "AND"))) {    // UNTIL ea <cc> ea AND
           //           .B/W/L       op3      <cc>      op4       DO         DO.?     label
-          outCmpBcc(&token[n+4], tokenEnd, stcLabel2, error);
+          outCmpBcc(&token[n+4], tokenEnd, untilLbl, error);
           NEWERROR(*errorPtr, error);
         }
       }
@@ -607,6 +733,7 @@ int asmStructure(int size, char *label, char *arg, int *errorPtr)
     // -------------------- FOR --------------------
     // FOR[.<size>] op1 = op2 TO op3 [BY op4] DO
     if (!(strcmp(token[1], "FOR"))) {
+      forLoop loop;
 
       // determine size of extent if present
       tokenEnd[0] = '\0';
@@ -624,6 +751,7 @@ int asmStructure(int size, char *label, char *arg, int *errorPtr)
         else if (tokenEnd[1] == 'L')
           extent = ".L\t";
         else {
+          extent = "";
           NEWERROR(*errorPtr, SYNTAX);
         }
       } else {
@@ -639,52 +767,42 @@ int asmStructure(int size, char *label, char *arg, int *errorPtr)
         else if (token[2][1] == 'L')
           sizeStr = ".L\t";
         else {
+          sizeStr = "";
           NEWERROR(*errorPtr, SYNTAX);
         }
       } else
         sizeStr = ".W\t";
 
-      stcLine = "\tMOVE" + sizeStr + (std::string)token[n+2] + "," + (std::string)token[n] + "\n";
+      stcOperand op1 = textOp(token[n]);
+      stcOperand op2 = textOp(token[n+2]);
       if ((strcmp(token[n+2],token[n])))  // if op1 != op2 (FOR D1 = D1 TO ... skips move)
-        assembleStc(stcLine.data());     // MOVE op2,op1
-
-      char buffer[9]; // 8 digits + null terminator
-      snprintf(buffer, 9, "%08X", stcLabelF);
-      std::string stcLabel = "_" + std::string(buffer);
+        stcCode("MOVE", sizeStr, &op2, &op1);   // MOVE op2,op1
 
-      
+      loop.label = stcLabelF;
       stcLabelF++;
 
-      snprintf(buffer, 9, "%08X", stcLabelF);
-      std::string stcLabel2 = "_" + std::string(buffer);
-
-      stcLine = "\tBRA" + extent + stcLabel2 + "\n";
-      assembleStc(stcLine.data());       //   BRA _20000001
+      stcOperand test = labelOp(stcLabelF);
+      stcCode("BRA", extent, &test, NULL);  //   BRA _20000001
       stcStack.push(stcLabelF);           // push _20000001
 
-      stcLine = stcLabel + "\n";
-      assembleStc(stcLine.data());       // _20000000
-
-      if (!(strcmp(token[n+3], "DOWNTO")))
-        stcLine = "\tBGE" + extent + stcLabel + "\n";
-      else
-        stcLine = "\tBLE" + extent + stcLabel + "\n";
-      forStack.push(stcLine);             // push Bcc _20000000
-
-      stcLine = "\tCMP" + sizeStr + (std::string)token[n+4] + "," + (std::string)token[n] + "\n";
-      forStack.push(stcLine);             // push CMP instruction
+      stcDefine(loop.label, "\n");        // _20000000
 
+      loop.size = sizeStr;
+      loop.extent = extent;
+      loop.counter = token[n];
+      loop.limit = token[n+4];
+      if (!(strcmp(token[n+3], "DOWNTO"))) {
+        loop.bcc = "BGE";                 // Bcc _20000000
+        loop.addSub = "SUB";
+      } else {
+        loop.bcc = "BLE";
+        loop.addSub = "ADD";
+      }
       if (!(strcmp(token[n+5], "BY")))
-        if (!(strcmp(token[n+3], "DOWNTO")))
-          stcLine = "\tSUB" + sizeStr + (std::string)token[n+6] + "," + (std::string)token[n] + "\n";
-        else
-          stcLine = "\tADD" + sizeStr + (std::string)token[n+6] + "," + (std::string)token[n] + "\n";
+        loop.step = token[n+6];
       else
-        if (!(strcmp(token[n+3], "DOWNTO")))
-          stcLine = "\tSUB" + sizeStr + "#1," + (std::string)token[n] + "\n";
-        else
-          stcLine = "\tADD" + sizeStr + "#1," + (std::string)token[n] + "\n";
-      forStack.push(stcLine);             // push SUB/ADD instruction
+        loop.step = "#1";
+      forStack.push(loop);
 
       stcLabelF++;                        // ready for next For instruction
       skipList = true;                    // don't display this line in ASSEMBLE.CPP
@@ -697,23 +815,16 @@ int asmStructure(int size, char *label, char *arg, int *errorPtr)
       if ((endfLbl & stcMask) != stcMaskF)  // if label is not from a FOR
         NEWERROR(*errorPtr, NO_FOR);
       else {
-        stcLine = forStack.top();
-        assembleStc(stcLine.data());       //   ADD|SUB op4,op1  or  ADD|SUB #1,op1
-        forStack.pop();
-
-
-        char buffer[9]; // 8 digits + null terminator
-        snprintf(buffer, 9, "%08X", endfLbl);
-        std::string stcLine = "_" + std::string(buffer);
-
-        assembleStc(stcLine.data());       // _20000001
-
-        stcLine = forStack.top();
-        assembleStc(stcLine.data());       //   CMP op3,op1
-        forStack.pop();
-
-        stcLine = forStack.top();
-        assembleStc(stcLine.data());       //   BLT .2  or  BGT .2
+        forLoop &loop = forStack.top();
+        stcOperand counter = textOp(loop.counter.c_str());
+        stcOperand limit = textOp(loop.limit.c_str());
+        stcOperand step = textOp(loop.step.c_str());
+        stcOperand body = labelOp(loop.label);
+
+        stcCode(loop.addSub, loop.size.c_str(), &step, &counter);  //   ADD|SUB op4,op1  or  ADD|SUB #1,op1
+        stcDefine(endfLbl, "");           // _20000001
+        stcCode("CMP", loop.size.c_str(), &limit, &counter);       //   CMP op3,op1
+        stcCode(loop.bcc, loop.extent.c_str(), &body, NULL);       //   BLE _20000000  or  BGE _20000000
         forStack.pop();
       }
       skipList = true;                        // don't display this line in ASSEMBLE.CPP
@@ -727,16 +838,12 @@ int asmStructure(int size, char *label, char *arg, int *errorPtr)
       if (token[2][1] < '0' || token[2][1] > '9' || token[3][0] != '=')
         NEWERROR(*errorPtr, SYNTAX);      // syntax must be DBLOOP Dn =
       dbStack.push(token[2][1]);          // push Dn number
-      stcLine = "\tMOVE\t" + (std::string)token[4] + "," + (std::string)token[2] + "\n";
+      stcOperand op1 = textOp(token[2]);
+      stcOperand op2 = textOp(token[4]);
       if ((strcmp(token[2],token[4])))    // if op1 != op2 (DBLOOP D0 = D0 ... skips move)
-        assembleStc(stcLine.data());     //   MOVE op2,op1
+        stcCode("MOVE", "\t", &op2, &op1);  //   MOVE op2,op1
 
-      char buffer[9]; // 8 digits + null terminator
-      snprintf(buffer, 9, "%08X", stcLabelD);
-      std::string stcLabel = "_" + std::string(buffer);
-
-      stcLine = stcLabel + "\n";
-      assembleStc(stcLine.data());
+      stcDefine(stcLabelD, "\n");
       stcStack.push(stcLabelD);
       stcLabelD++;
       skipList = true;                        // don't display this line in ASSEMBLE.CPP
@@ -749,22 +856,17 @@ int asmStructure(int size, char *label, char *arg, int *errorPtr)
       stcStack.pop();
       if ((unlessLbl & stcMask) != stcMaskD)       // if label is not from a DBLOOP
         NEWERROR(*errorPtr, NO_DBLOOP);
-      
-      char buffer[9]; // 8 digits + null terminator
-      snprintf(buffer, 9, "%08X", unlessLbl);
-      
-      std::stringstream stcLabelsus;
-      stcLabelsus << "\tD" << dbStack.top() << ",_" << std::setw(8) << std::setfill('0') << std::hex << unlessLbl;
-
-      std::string stcLabel = stcLabelsus.str();
 
-      
+      char dn[3] = { 'D', dbStack.top(), '\0' };
+      char dbcc[8];                     // DBcc
+      stcOperand reg = textOp(dn);
+      stcOperand loopLabel = labelOp(unlessLbl);
+      loopLabel.format = "_%08x";       // listed in lowercase
       dbStack.pop();
 
       // UNLESS <F> and UNLESS use DBRA
       if ( !(strcmp(token[n], "<F>")) || token[2][0] == '\0') {
-        stcLine = "\tDBRA" + stcLabel + "\n";
-        assembleStc(stcLine.data());
+        stcCode("DBRA", "\t", &reg, &loopLabel);
       } else {
         // determine size of CMP
         if (token[2][0] == '.') {
@@ -774,36 +876,36 @@ int asmStructure(int size, char *label, char *arg, int *errorPtr)
             sizeStr = ".W\t";
           else if (token[2][1] == 'L')
             sizeStr = ".L\t";
-          else
+          else {
+            sizeStr = "";
             NEWERROR(*errorPtr, SYNTAX);
+          }
         } else
           sizeStr = ".W\t";
 
+        stcOperand op1 = textOp(token[n]);
+        stcOperand op2 = textOp(token[n+2]);
         if (token[n][0] == '<') {                      // UNLESS <cc>
-          stcLine = "\tD" + getBcc(token[n],IF_CC,0) + stcLabel + "\n";
-          assembleStc(stcLine.data());
+          snprintf(dbcc, sizeof(dbcc), "D%s", getBcc(token[n],IF_CC,0));
+          stcCode(dbcc, "\t", &reg, &loopLabel);
         }else if (token[n][0] == '#') {                // UNLESS #nn <cc> ea
-          stcLine = "\tCMP" + sizeStr + (std::string)token[n] + "," + (std::string)token[n+2] + "\n";
-          assembleStc(stcLine.data());
-          stcLine = "\tD" + getBcc(token[n+1],IM_EA,0) + stcLabel + "\n";
-          assembleStc(stcLine.data());
+          stcCode("CMP", sizeStr, &op1, &op2);
+          snprintf(dbcc, sizeof(dbcc), "D%s", getBcc(token[n+1],IM_EA,0));
+          stcCode(dbcc, "\t", &reg, &loopLabel);
         }else if (token[n+2][0] == '#') {                // UNLESS ea <cc> #nn
-          stcLine = "\tCMP" + sizeStr + (std::string)token[n+2] + "," + (std::string)token[n] + "\n";
-          assembleStc(stcLine.data());
-          stcLine = "\tD" + getBcc(token[n+1],EA_IM,0) + stcLabel + "\n";
-          assembleStc(stcLine.data());
+          stcCode("CMP", sizeStr, &op2, &op1);
+          snprintf(dbcc, sizeof(dbcc), "D%s", getBcc(token[n+1],EA_IM,0));
+          stcCode(dbcc, "\t", &reg, &loopLabel);
         // UNLESS Rn <cc> ea
         }else if ((token[n][0]=='A' || token[n][0]=='D') && isRegNum(token[n][1])) {
-          stcLine = "\tCMP" + sizeStr + (std::string)token[n+2] + "," + (std::string)token[n] + "\n";
-          assembleStc(stcLine.data());
-          stcLine = "\tD" + getBcc(token[n+1],RN_EA,0) + stcLabel + "\n";
-          assembleStc(stcLine.data());
+          stcCode("CMP", sizeStr, &op2, &op1);
+          snprintf(dbcc, sizeof(dbcc), "D%s", getBcc(token[n+1],RN_EA,0));
+          stcCode(dbcc, "\t", &reg, &loopLabel);
         // UNLESS ea <cc> Rn
         }else if ((token[n+2][0]=='A' || token[n+2][0]=='D') && isRegNum(token[n+2][1])) {
-          stcLine = "\tCMP" + sizeStr + (std::string)token[n] + "," + (std::string)token[n+2] + "\n";
-          assembleStc(stcLine.data());
-          stcLine = "\tD" + getBcc(token[n+1],EA_RN,0) + stcLabel + "\n";
-          assembleStc(stcLine.data());
+          stcCode("CMP", sizeStr, &op1, &op2);
+          snprintf(dbcc, sizeof(dbcc), "D%s", getBcc(token[n+1],EA_RN,0));
+          stcCode(dbcc, "\t", &reg, &loopLabel);
         }else{
           NEWERROR(*errorPtr, SYNTAX);
         }
@@ -815,22 +917,3 @@ int asmStructure(int size, char *label, char *arg, int *errorPtr)
   }
   return NORMAL;
 }
-
-void assembleStc(char* line)
-{
-  std::string tempLine;
-  int error = OK;
-  int i=0;
-  while(lineIdent[i] && i<MACRO_NEST_LIMIT)
-    i++;
-  lineIdent[i]='s';     // line identifier for listing
-  lineIdent[i+1]='\0';
-  if (!SEXflag)
-    skipList = true;
-  else
-    if (!(macroNestLevel > 0 && skipList == true)) // if not called from macro with listing off
-      skipList = false;
-  assemble(line, &error);
-  lineIdent[i]='\0';
-}
-
@@ -23,38 +23,145 @@
 
 #include "asm.h"
 
-extern FILE *listFile;
 extern char buffer[256];  //ck used to form messages for display in windows
 extern char numBuf[20];
-extern char globalLabel[SIGCHARS+1];
+extern symbolDef *globalScope;   // last global label, scope of local labels
+extern bool onePass;            // true while assembling in one pass
 
 
-/* MAXHASH is the range of the hash function. hash()
-   returns values from 0 to MAXHASH inclusive. */
+// The symbol table is an open addressing hash table using linear probing.
+// The number of slots is always a power of two and a table doubles in
+// size whenever it becomes more than half full, so a search normally
+// examines only one or two slots regardless of the number of symbols.
+//
+// Global symbols are kept in the root table. The local labels that follow
+// a global label are kept in a child table owned by that label, so a local
+// label is found by its own name without building the global:local name.
+//
+// Macros are also entered in a table of their own so an opcode that is
+// not an instruction is checked against the macro names only.
+//
+// Symbol entries are allocated from an arena of fixed size blocks and
+// names are copied once into a pool of character blocks. Blocks are kept
+// when the table is cleared so the next assembly reuses the same memory.
+
+const unsigned int MINSLOTS = 1024;     // initial number of root slots
+const unsigned int MINLOCALSLOTS = 16;  // initial number of child slots
+const unsigned int MINMACROSLOTS = 64;  // initial number of macro slots
+const int SYMBLOCK = 1024;              // symbol entries per arena block
+const int NAMEBLOCK = 16384;            // characters per name pool block
 
-#define MAXHASH 26
+struct symbolTable {
+  symbolDef **slots;                    // slots, NULL when empty
+  unsigned int size;                    // number of slots (power of two)
+  unsigned int count;                   // number of symbols in table
+};
 
-symbolDef *htable[MAXHASH+1];
+symbolTable symRoot = { NULL, 0, 0 };   // global symbols
+symbolTable macroTable = { NULL, 0, 0 };        // macro names
 bool symbolInit = false;
+int symbolsRenewed = 0;                 // OLD_SYM symbols defined again
+bool symbolsChanged = false;            // a symbol is new or changed value
+
+struct symBlock {
+  symBlock *next;
+  symbolDef entries[SYMBLOCK];
+};
+
+struct nameBlock {
+  nameBlock *next;
+  char chars[NAMEBLOCK];
+};
+
+symBlock *symFirst = NULL;              // first arena block
+symBlock *symCurrent = NULL;            // block being allocated from
+int symUsed = 0;                        // entries used in current block
+nameBlock *nameFirst = NULL;            // first name pool block
+nameBlock *nameCurrent = NULL;          // block being allocated from
+int nameUsed = 0;                       // characters used in current block
 
 //---------------------------------------------------
-// delete the symbol table memory
-void clearSymbols()
+// Return a new symbol entry from the arena
+static symbolDef *newSymbol()
+{
+  if (!symCurrent || symUsed == SYMBLOCK) {
+    symBlock *b = symCurrent ? symCurrent->next : symFirst;
+    if (!b) {                           // no block left to reuse
+      b = new symBlock;
+      b->next = NULL;
+      if (symCurrent)
+        symCurrent->next = b;
+      else
+        symFirst = b;
+    }
+    symCurrent = b;
+    symUsed = 0;
+  }
+  return &symCurrent->entries[symUsed++];
+}
+
+//---------------------------------------------------
+// Copy len characters of name to the name pool and return pointer
+// to the null terminated copy
+static const char *newName(const char *name, int len)
 {
-  symbolDef *last, *s;         //last, symbol;
+  if (!nameCurrent || nameUsed + len + 1 > NAMEBLOCK) {
+    nameBlock *b = nameCurrent ? nameCurrent->next : nameFirst;
+    if (!b) {                           // no block left to reuse
+      b = new nameBlock;
+      b->next = NULL;
+      if (nameCurrent)
+        nameCurrent->next = b;
+      else
+        nameFirst = b;
+    }
+    nameCurrent = b;
+    nameUsed = 0;
+  }
+  char *p = &nameCurrent->chars[nameUsed];
+  memcpy(p, name, len);
+  p[len] = '\0';
+  nameUsed += len + 1;
+  return p;
+}
 
+//---------------------------------------------------
+// Allocate an empty table of the specified number of slots
+static void initTable(symbolTable *t, unsigned int slots)
+{
+  t->slots = new symbolDef*[slots];
+  for (unsigned int i=0; i<slots; i++)
+    t->slots[i] = NULL;
+  t->size = slots;
+}
+
+//---------------------------------------------------
+// clear the symbol table
+// The child tables of local labels are dropped, the arena and name pool
+// are reset and their blocks are kept for reuse.
+void clearSymbols()
+{
   try {
-  for (int i=0; i<=MAXHASH; i++) {      // for all values of hash()
-    s = htable[i];
+  symbolDef *s;
+  for (unsigned int i=0; i<symRoot.size && symRoot.count; i++) {
+    s = symRoot.slots[i];
     if (s) {
-      htable[i] = NULL;         // clear pointer
-      while (s) {               // while symbols remain in the list
-        last = s;
-        s = s->next;
-        delete last;            // delete symbol from memory
+      if (s->locals) {                  // drop scope of local labels
+        delete[] s->locals->slots;
+        delete s->locals;
       }
+      symRoot.slots[i] = NULL;
+      symRoot.count--;
     }
   }
+  if (macroTable.count) {
+    memset(macroTable.slots, 0, macroTable.size * sizeof(symbolDef *));
+    macroTable.count = 0;
+  }
+  symCurrent = NULL;
+  symUsed = 0;
+  nameCurrent = NULL;
+  nameUsed = 0;
   symbolInit = false;
   }
   catch( ... ) {
@@ -63,6 +170,100 @@ void clearSymbols()
   }
 }
 
+//---------------------------------------------------
+// Mark every symbol OLD_SYM before pass 1 is run again by OPT RELAX, or
+// after one pass assembly fails. A marked symbol is treated as undefined
+// until it is defined again, as it would be in the first pass 1, but its
+// previous value is kept as the estimate of a forward reference for
+// OPT RELAX. Returns the number of symbols.
+int ageSymbols()
+{
+  symbolDef *s, *l;
+  int n = 0;
+
+  for (unsigned int i=0; i<symRoot.size; i++) {
+    if ((s = symRoot.slots[i])) {
+      s->flags |= OLD_SYM;
+      n++;
+      if (s->locals)
+        for (unsigned int j=0; j<s->locals->size; j++)
+          if ((l = s->locals->slots[j])) {
+            l->flags |= OLD_SYM;
+            n++;
+          }
+    }
+  }
+  symbolsRenewed = 0;
+  symbolsChanged = false;
+  return n;
+}
+
+//---------------------------------------------------
+// Double the number of slots and reinsert every symbol
+static void growTable(symbolTable *t)
+{
+  symbolDef **oldSlots = t->slots;
+  unsigned int oldSize = t->size;
+  unsigned int h;
+
+  initTable(t, oldSize * 2);
+  for (unsigned int i=0; i<oldSize; i++) {
+    if (oldSlots[i]) {
+      h = oldSlots[i]->hash & (t->size - 1);
+      while (t->slots[h])                       // find empty slot
+        h = (h + 1) & (t->size - 1);
+      t->slots[h] = oldSlots[i];
+    }
+  }
+  delete[] oldSlots;
+}
+
+//---------------------------------------------------
+// Search table t for the first len characters of name.
+// The symbol is created if not found and create is true.
+static symbolDef *search(symbolTable *t, const char *name, int len, int create, int *errorPtr)
+{
+  unsigned int hv, h;
+  symbolDef *s;
+
+  // Probe from the home slot until the symbol or an empty slot is found
+  hv = hash(name, len);
+  h = hv & (t->size - 1);
+  while ((s = t->slots[h]) &&
+         (s->hash != hv || s->length != len || memcmp(s->name, name, len)))
+    h = (h + 1) & (t->size - 1);
+
+  if (s && (s->flags & OLD_SYM)) {
+    // A symbol of the previous pass 1 is defined again or is not yet
+    // defined. The caller may still use its old value as an estimate.
+    if (!create)
+      NEWERROR(*errorPtr, UNDEFINED);
+  }
+  else if (s) {
+    // If a match was found, return pointer to the structure
+    if (create) {
+      if (!(s->flags & REDEFINABLE))  // if not SET directive (CK 10/12/2009)
+        NEWERROR(*errorPtr, MULTIPLE_DEFS);
+    }
+  }
+  // Otherwise put the symbol in the empty slot
+  else if (create) {
+    s = newSymbol();
+    s->hash = hv;
+    s->length = len;
+    s->name = newName(name, len);
+    s->locals = NULL;
+    symbolsChanged = true;
+    t->slots[h] = s;
+    t->count++;
+    if (t->count * 2 > t->size)       // keep the table at most half full
+      growTable(t);
+  } else
+    NEWERROR(*errorPtr, UNDEFINED);
+
+  return s;
+}
+
 //--------------------------------------------------------------------------
 //    Function: lookup()
 //		Searches the symbol table for a previously defined
@@ -79,11 +280,15 @@ void clearSymbols()
 //      	  Y     FALSE     None		  OK
 //		  Y	true      None		  MULTIPLE_DEFS
 //
+//		A symbol marked OLD_SYM by ageSymbols() is found as if
+//		it were not in the table, except that it is returned.
+//
 //		In addition, the routine always returns a pointer to
 //		the structure (type symbolDef) which contains the
 //		symbol that was found or created. The routine uses a
-//		hash function to index into an array of pointers to
-//		ordered linked lists of symbol definitions.
+//		hash function to index into an open addressing table
+//		of pointers to symbol definitions. NULL is returned
+//		when the symbol is not found and not created.
 //
 //	 Usage:	symbolDef *lookup(sym, create, errorPtr)
 //		char *sym;
@@ -91,85 +296,55 @@ void clearSymbols()
 
 symbolDef *lookup(char *sym, int create, int *errorPtr)
 {
-  int h, cmp;
-  symbolDef *s, *last, *t;
+  symbolDef *t;
   char sym2[SIGCHARS+1];        // CK for local labels
-  int i, j;
+  int len, glen;
 
   try {
 
+  if (!symbolInit) {
+    if (!symRoot.slots)
+      initTable(&symRoot, MINSLOTS);
+    symbolInit = true;
+  }
+
+  len = strlen(sym);
+
   // Local label code  CK May-22-2009 mod Sep-23-2009
   // Local labels begin with '.'
-  // A local label is converted to a unique label here by appending the
-  // local label to the last global label stored in globalLabel.
-  // Simple name mangling is done by replacing . with : to prevent
-  // duplicate symbol errors with user created labels and to prevent labels
-  // that contain dots in the middle of the label that confuses the parser
-  // because of the .L that may be used to force long addressing with labels.
-  // The new unique label takes the form of global:local.
+  // A local label belongs to the last global label, globalScope, and is
+  // kept in the child table of that label. It behaves as the unique label
+  // global:local, which is the name shown in the symbol table listing.
+  // The global:local name is limited to SIGCHARS characters like any other
+  // label so the local part is truncated to fit.
   if (*sym == '.') {            // if local label
-    *sym = ':';
-    i = 0;
-    j = 0;
-    while(i<SIGCHARS && globalLabel[i] != '\0') {
-      sym2[i] = globalLabel[i]; // make unique global label from local label
-      i++;
-    }
-    while(i<SIGCHARS && sym[j])
-      sym2[i++] = sym[j++];
-    sym2[i] = '\0';
-    if (i >= SIGCHARS)
+    glen = globalScope ? globalScope->length : 0;
+    if (glen + len >= SIGCHARS) {
       NEWERROR(*errorPtr, LABEL_TOO_LONG);
-
-    strcpy(sym, sym2);
-  }
-
-  if (!symbolInit) {
-    for (h = 0; h <= MAXHASH; h++)
-      htable[h] = 0;
-    symbolInit = true;
-  }
-  h = hash(sym);
-  s = htable[h];
-  if (s) {
-    // Search the linked list for a matching symbol
-    last = NULL;
-    while (s && (cmp = strcmp(s->name, sym)) < 0) {
-      last = s;
-      s = s->next;
+      len = SIGCHARS - glen;
     }
-    // If a match was found, return pointer to the structure
-    if (s && !cmp) {
-      if (create) {
-        if (!(s->flags & REDEFINABLE))  // if not SET directive (CK 10/12/2009)
- 	  NEWERROR(*errorPtr, MULTIPLE_DEFS);
-      }
-      t = s;
+    if (!globalScope) {         // no global label yet, use :local
+      sym2[0] = ':';
+      memcpy(&sym2[1], &sym[1], len - 1);
+      t = search(&symRoot, sym2, len, create, errorPtr);
     }
-    // Otherwise insert the symbol in the list
-    else if (create)
-      if (last) {
-	// The symbol goes after an existing symbol
-	t = new symbolDef;
-	last->next = t;
-	t->next = s;
-	strcpy(t->name, sym);
-      } else {
-	/* The symbol goes at the head of a list */
-	t = new symbolDef;
-	t->next = htable[h];
-	htable[h] = t;
-	strcpy(t->name, sym);
+    else if (len <= 0)          // nothing left of local part
+      t = search(&symRoot, globalScope->name, glen, create, errorPtr);
+    else {
+      if (!globalScope->locals) {
+        if (!create) {
+          NEWERROR(*errorPtr, UNDEFINED);
+          return NULL;
+        }
+        globalScope->locals = new symbolTable;
+        globalScope->locals->count = 0;
+        initTable(globalScope->locals, MINLOCALSLOTS);
       }
-    else
-      NEWERROR(*errorPtr, UNDEFINED);
-  } else if (create) {
-    t = new symbolDef;
-    htable[h] = t;
-    t->next = NULL;
-    strcpy(t->name, sym);
-  } else
-    NEWERROR(*errorPtr, UNDEFINED);
+      t = search(globalScope->locals, sym, len, create, errorPtr);
+    }
+  }
+  else
+    t = search(&symRoot, sym, len, create, errorPtr);
 
   }
   catch( ... ) {
@@ -180,45 +355,129 @@ symbolDef *lookup(char *sym, int create, int *errorPtr)
   return t;
 }
 
+//----------------------------------------------
+// Enter the macro symbol in the macro table
+void addMacro(symbolDef *symbol)
+{
+  unsigned int h;
+
+  if (!macroTable.slots)
+    initTable(&macroTable, MINMACROSLOTS);
+  h = symbol->hash & (macroTable.size - 1);
+  while (macroTable.slots[h]) {
+    if (macroTable.slots[h] == symbol)  // already entered
+      return;
+    h = (h + 1) & (macroTable.size - 1);
+  }
+  macroTable.slots[h] = symbol;
+  macroTable.count++;
+  if (macroTable.count * 2 > macroTable.size)
+    growTable(&macroTable);
+}
+
+//----------------------------------------------
+// Search the macro table for the first len characters of name.
+// hv is the value of hash(name, len). Returns NULL if not found.
+symbolDef *macroLookup(const char *name, int len, unsigned int hv)
+{
+  unsigned int h;
+  symbolDef *s;
+
+  if (!macroTable.count)
+    return NULL;
+  h = hv & (macroTable.size - 1);
+  while ((s = macroTable.slots[h]) &&
+         (s->hash != hv || s->length != len || memcmp(s->name, name, len)))
+    h = (h + 1) & (macroTable.size - 1);
+  return s;
+}
+
+//----------------------------------------------
+// Symbol name and value for symbol listing
+struct listSymbol {
+  char name[SIGCHARS+1];
+  int value;
+};
+
+//----------------------------------------------
+// Sort function for symbol listing. Names that start with A to Z come
+// first, then all others, as the symbol table listed them when it kept a
+// list for each first letter.
+static int compareSymbols(const void *a, const void *b)
+{
+  const char *nameA = ((listSymbol *)a)->name;
+  const char *nameB = ((listSymbol *)b)->name;
+  bool letterA = isupper((unsigned char) *nameA) != 0;
+  bool letterB = isupper((unsigned char) *nameB) != 0;
+
+  if (letterA != letterB)
+    return letterA ? -1 : 1;
+  return strcmp(nameA, nameB);
+}
+
 //----------------------------------------------
 // Write the symbol table to the listing file
+// The slots of the hash tables are in no particular order so the symbols
+// are gathered and sorted by name first. Local labels are listed with
+// their global:local name. A symbol still marked OLD_SYM was not defined
+// by the last pass 1 and is not listed.
 int optCRE()
 {
-  symbolDef *s;         //, *last;
-  int bytes;
+  symbolDef *s, *l;
+  listSymbol *sorted;
+  unsigned int i, j, n;
+  char text[SIGCHARS*2 + 16];           // global:local name and value
 
-  fprintf(listFile, "\n\nSYMBOL TABLE INFORMATION\n");
-  fprintf(listFile, "Symbol-name         Value\n");
-  fprintf(listFile, "-------------------------\n");
+  listText("\n\nSYMBOL TABLE INFORMATION\n");
+  listText("Symbol-name         Value\n");
+  listText("-------------------------\n");
 
-  for (int i=0; i<=MAXHASH; i++) {      // for all values of hash()
-    s = htable[i];
-    if (s) {
-      //last = NULL;
-      while (s) {               // while symbols remain in the list
-        //last = s;
-        //fprintf(listFile, "%s\t\t%X\n",s->name, s->value);
-        bytes = fprintf(listFile, "%s",s->name);
-        // print value in column 20 or 2 spaces after label if label >= 18 chars
-        while (bytes++ < 18)
-          fprintf(listFile, " ");
-        fprintf(listFile, "  %X\n",s->value);
-        s = s->next;
+  n = symRoot.count;
+  for (i=0; i<symRoot.size; i++)        // count local labels
+    if ((s = symRoot.slots[i]) && s->locals)
+      n += s->locals->count;
+
+  sorted = new listSymbol[n + 1];
+  n = 0;
+  for (i=0; i<symRoot.size; i++) {      // for all slots
+    if ((s = symRoot.slots[i])) {
+      if (!(s->flags & OLD_SYM)) {
+        strcpy(sorted[n].name, s->name);
+        sorted[n++].value = s->value;
+      }
+      if (s->locals) {
+        for (j=0; j<s->locals->size; j++) {
+          if ((l = s->locals->slots[j]) && !(l->flags & OLD_SYM)) {
+            sprintf(sorted[n].name, "%s:%s", s->name, &l->name[1]);
+            sorted[n++].value = l->value;
+          }
+        }
       }
     }
   }
+  qsort(sorted, n, sizeof(listSymbol), compareSymbols);
+
+  for (i=0; i<n; i++) {
+    // print value in column 20 or 2 spaces after label if label >= 18 chars
+    sprintf(text, "%-18s  %X\n", sorted[i].name, sorted[i].value);
+    listText(text);
+  }
+  delete[] sorted;
   return NORMAL;
 }
 
 //---------------------------------------------------------------------
-// Return index for array of pointers to linked lists
-// Returns 0 to MAXHASH inclusive based on first character of symbol.
-int hash(char *symbol)
+// Return hash value of the first len characters of symbol (32 bit FNV-1a)
+// The caller masks the value to the size of the table.
+unsigned int hash(const char *symbol, int len)
 {
-  if (isupper(*symbol))
-    return (*symbol - 'A');
-  else
-    return MAXHASH;
+  unsigned int h = FNV_BASIS;
+
+  while (len--) {
+    h ^= (unsigned char) *symbol++;
+    h *= FNV_PRIME;
+  }
+  return h;
 }
 
 
@@ -233,6 +492,8 @@ int hash(char *symbol)
 //	FALSE, then the symbol is defined and its value is set
 //	equal to the supplied number. The function returns a
 //	pointer to the symbol definition structure.
+//	In one pass assembly the symbol is defined as in pass 1
+//	and is a backward reference from then on.
 //
 //      Usage:	symbolDef *define(sym, value, pass2, check, errorPtr)
 //      	char *sym;
@@ -242,14 +503,14 @@ symbolDef *define(char *sym, int value, bool pass2, bool check, int *errorPtr) {
   symbolDef *symbol;
   bool labelIsGlobal = (*sym != '.');   // local label code CK Sep-23-2009
 
-  symbol = lookup(sym, !pass2, errorPtr);
+  symbol = lookup(sym, !pass2 || onePass, errorPtr);
   if (*errorPtr < ERRORN) {
 
     // local label code CK Sep-23-2009
     if (labelIsGlobal)
-      strncpy(globalLabel, sym, SIGCHARS); // set globalLabel for future use
+      globalScope = symbol;     // scope of following local labels
 
-    if (pass2) {
+    if (pass2 && !onePass) {
       if (check) {      // if check for phase error
         if (symbol->value != value)
           if (symbol->flags & BACKREF)  // if symbol already defined
@@ -261,8 +522,13 @@ symbolDef *define(char *sym, int value, bool pass2, bool check, int *errorPtr) {
       if (symbol->flags & REDEFINABLE)  // ck 1-10-2008
         symbol->value = value;          //  "
     } else {  // define the symbol
+      if (symbol->flags & OLD_SYM) {  // defined by previous pass 1
+        symbolsRenewed++;
+        if (symbol->value != value && !(symbol->flags & REDEFINABLE))
+          symbolsChanged = true;
+      }
       symbol->value = value;
-      symbol->flags = 0;
+      symbol->flags = (onePass) ? BACKREF : 0;
     }
   }
   return symbol;
@@ -0,0 +1,47 @@
+#!/bin/bash
+#
+# DC string test. Assembles DC strings longer than 256 characters and
+# checks the number of bytes in the S-record file.
+#
+#   tests/dcstring.sh [assembler]
+#
+# The assembler defaults to ./Rigel68K.
+
+ASM=${1:-./Rigel68K}
+
+if [ ! -x "$ASM" ]; then
+    echo "no assembler $ASM, run ./build.sh first" >&2
+    exit 1
+fi
+
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+
+# 300 bytes, 401 characters padded to 402 bytes, then one word
+awk 'BEGIN {
+    a = sprintf("%300s", ""); gsub(/ /, "A", a)
+    b = sprintf("%401s", ""); gsub(/ /, "B", b)
+    print " org $1000"
+    print " dc.b \x27" a "\x27"
+    print " dc.w \x27" b "\x27,1"
+    print " end $1000"
+}' > $DIR/dcstring.x68
+
+"$ASM" $DIR/dcstring.x68 $DIR/out > /dev/null
+if [ $? -ne 0 ] || ! grep -q "^No errors detected" $DIR/out.L68; then
+    echo "FAIL: dcstring.x68 did not assemble" >&2
+    exit 1
+fi
+
+# data bytes of each S1, S2 and S3 record: count less address and checksum
+BYTES=$(awk '/^S[123]/ {
+    n = index("0123456789ABCDEF", substr($0, 3, 1)) * 16 - 16
+    n += index("0123456789ABCDEF", substr($0, 4, 1)) - 1
+    total += n - substr($0, 2, 1) - 2
+} END { print total + 0 }' $DIR/out.S68)
+
+if [ "$BYTES" != 704 ]; then
+    echo "FAIL: $BYTES bytes of object code, 704 expected" >&2
+    exit 1
+fi
+echo "PASS: dcstring"